@@ -1,50 +1,42 @@
-
 #include "cuda_runtime.h"
 #include "device_launch_parameters.h"
 #include "cuComplex.h"
 
 #include <stdio.h>
-
-#include <windows.h>
-#include <tchar.h>
-
-// Synchronization primitives for communicating with plugin client.
-// (or any other process that uses these named objects).
-TCHAR szName[] = TEXT("Local\\GPUModalBankMem");
-TCHAR szNameSemaphore[] = TEXT("Local\\GPUModalBankSemaphore");
-TCHAR szNameSemaphoreGPU[] = TEXT("Local\\GPUModalBankSemaphoreGPU");
-#define SHAREDMEMSIZE 1024*512*2
-
-#define BUFFERSIZE 256
-constexpr int NDRUMS = 10;
-constexpr int NMODES = NDRUMS * 1024;
-constexpr int NWARPS = 320;  // 10240/32
-
-static float host_samplebuffer[BUFFERSIZE*NWARPS*2];
-
-// Shared Memory Layout
+#include <stdlib.h>
+
+// Shared memory layout and synchronization primitives for communicating with plugin client
+// (or any other process that opens the same named region). Shared with the plugin sources.
+#include "JuceGPUDrum/SharedLayout.h"
+#include "JuceGPUDrum/SharedMemoryRegion.h"
+#include "JuceGPUDrum/Doorbell.h"
+#include "JuceGPUDrum/ServerStats.h"
+
+using drumgpu::ModeTable;
+
+constexpr int BUFFERSIZE = drumgpu::kBufferSize;
+// Jobs use a varying number of banks (voices) of kModesPerDrum modes, up to MAXBANKS.
+constexpr int NDRUMS = drumgpu::kNumDrums;
+constexpr int MAXBANKS = drumgpu::kMaxBanks;
+constexpr int NMODES = drumgpu::kNumModes;
+constexpr int WARPS_PER_BANK = drumgpu::kModesPerDrum / 32;
+
+// Final reduction: each block sums the per-warp partials for REDUCE_COLS output samples.
+constexpr int REDUCE_COLS = 32;
+constexpr int REDUCE_ROWS = 32;
+static_assert((BUFFERSIZE * 2) % REDUCE_COLS == 0, "reduction blocks must cover the output");
+
+// Shared Memory Layout: see SharedLayout.h.
 // ----- First Section: Input parameters -----
-// 10000 modes *
-struct ModeInfo {
-	bool enabled;
-	bool reset;
-
-	bool amp_changed;
-	float amp_real;
-	float amp_imag;
-	
-	float damp;
-	float freq;
-	bool freq_changed;
-};  // approximately 8 * 4 bytes = 32 bytes
-// all modes total = 320000 = 320KB
+// ModeTable: one 128-byte-aligned plane per parameter, so each warp's loads coalesce.
+// 4 float planes + flags = 17 bytes per mode, all modes total = 174080 = 170KB
 
 // ----- Drum info ----
 // Cleanup: should reorder these sections, but these were added chronologically.
 // 10 drums * 8 controllable params per drum.
 
-/// ----- Input State -----
-// NDRUMS times BUFFERSIZE for inputs. = 10240 = 10KB
+/// ----- Excitations -----
+// Up to kMaxExcitations hit events; each bank's input is synthesized from them on the GPU.
 
 // ----- Third Section: Audio output to Host -----
 // 4 bytes per sample * 1024 buffer size (supports stereo@512) = 4K
@@ -59,9 +51,70 @@ __device__ __forceinline__ cuFloatComplex custom_cexpf(cuFloatComplex z) {
 	return res;
 }
 
-__global__ void filterbankKernel(float *yprev, const ModeInfo *mi, const float* drumInfo, const float* input, float* output) {
-	int i = threadIdx.x + blockIdx.x * blockDim.x;
-	int whichwarp = (int)(i / 32);
+// Sum |y|^2 over a warp's modes into its bank's energy, for putting banks to sleep.
+__device__ __forceinline__ void addWarpEnergy(cuComplex y, float* energy) {
+	float e = y.x * y.x + y.y * y.y;
+	for (int offset = 16; offset > 0; offset /= 2) {
+		e += __shfl_down_sync(0xffffffff, e, offset);
+	}
+	if ((threadIdx.x % 32) == 0) {
+		atomicAdd(energy, e);
+	}
+}
+
+// Renders a block with no input in closed form: y[n] = p^(n+1) y0 for the pole p = exp(log_pole).
+// Rather than stepping each mode through the block and tree-summing every sample across the warp,
+// lane l sums the warp's 32 modes for samples l, l + 32, ...: it fetches each mode's state and
+// pole once, starts from p^(l+1) and steps by p^32. |warpOut| is the warp's interleaved stereo
+// block. Returns the state after the block, p^BUFFERSIZE y0.
+static_assert(BUFFERSIZE % 32 == 0, "undriven blocks are rendered 32 samples per step");
+__device__ cuComplex renderUndrivenWarp(cuComplex y, cuComplex log_pole, float pan, float* warpOut) {
+	const int lane = threadIdx.x % 32;
+	const cuComplex step = custom_cexpf(make_cuComplex(32.0f * log_pole.x, 32.0f * log_pole.y));
+	float sum[BUFFERSIZE / 32] = {};
+	for (int m = 0; m < 32; m++) {
+		cuComplex ym = make_cuComplex(__shfl_sync(0xffffffff, y.x, m), __shfl_sync(0xffffffff, y.y, m));
+		cuComplex lm = make_cuComplex(__shfl_sync(0xffffffff, log_pole.x, m), __shfl_sync(0xffffffff, log_pole.y, m));
+		cuComplex sm = make_cuComplex(__shfl_sync(0xffffffff, step.x, m), __shfl_sync(0xffffffff, step.y, m));
+		cuComplex z = cuCmulf(custom_cexpf(make_cuComplex((lane + 1) * lm.x, (lane + 1) * lm.y)), ym);
+		for (int k = 0; k < BUFFERSIZE / 32; k++) {
+			sum[k] += z.x;
+			z = cuCmulf(sm, z);
+		}
+	}
+	for (int k = 0; k < BUFFERSIZE / 32; k++) {
+		const int samp = lane + 32 * k;
+		warpOut[2 * samp] = sum[k] * pan;
+		warpOut[2 * samp + 1] = sum[k] * (1 - pan);
+	}
+	return cuCmulf(custom_cexpf(make_cuComplex(BUFFERSIZE * log_pole.x, BUFFERSIZE * log_pole.y)), y);
+}
+
+// Synthesize |bank|'s input for the block into |drumInput| from those of |events| naming it.
+// Returns whether any of the samples this thread wrote are nonzero.
+__device__ bool synthesizeInput(const drumgpu::Excitation* events, int numEvents, int bank, float* drumInput) {
+	bool driven = false;
+	for (int samp = threadIdx.x; samp < BUFFERSIZE; samp += blockDim.x) {
+		float in = 0.0f;
+		for (int e = 0; e < numEvents; e++) {
+			if (events[e].bank == (uint32_t)bank) {
+				in += drumgpu::excitationSample(events[e], samp);
+			}
+		}
+		drumInput[samp] = in;
+		driven |= in != 0.0f;
+	}
+	return driven;
+}
+
+// One block per awake bank: block b renders bank bankList[b] into the b-th group of per-warp outputs.
+__global__ void filterbankKernel(float *yprev, const ModeTable *mi, const float* drumInfo, const drumgpu::ExcitationList* excitations,
+	float* output, const int* bankList, float* bankEnergy) {
+	__shared__ float drumInput[BUFFERSIZE];
+
+	int whichDrum = bankList[blockIdx.x];
+	int i = threadIdx.x + whichDrum * blockDim.x;
+	int whichwarp = (int)((threadIdx.x + blockIdx.x * blockDim.x) / 32);
 	bool is_first_thread_in_warp = (i % 32) == 0;
 
 	// Init - pull from shared memory.
@@ -69,36 +122,51 @@ __global__ void filterbankKernel(float *yprev, const ModeInfo *mi, const float*
 	y.x = yprev[2 * i];
 	y.y = yprev[2 * i + 1];
 
-	if (mi[i].reset) {
+	if (mi->flags[i] & drumgpu::kModeReset) {
 		y.x = 0.0f;
 		y.y = 0.0f;
 	}
 
 	cuComplex input_amp;
-	input_amp.x = mi[i].amp_real;
-	input_amp.y = mi[i].amp_real;
+	input_amp.x = mi->ampRe[i];
+	input_amp.y = mi->ampRe[i];
 
 	cuComplex input_complex;
 
-	cuComplex exp_term;
-	{
-		// regenerate
-		cuComplex e_stuff;
-		e_stuff.x = -mi[i].damp;
-		e_stuff.y = mi[i].freq;
-		exp_term = custom_cexpf(e_stuff);
+	// regenerate
+	cuComplex log_pole;
+	log_pole.x = -mi->damp[i];
+	log_pole.y = mi->freq[i];
+	cuComplex exp_term = custom_cexpf(log_pole);
+
+	// Most blocks have no input (hits only shape the first samples of a block).
+	const bool driven = __syncthreads_or(synthesizeInput(excitations->events,
+		min((int)excitations->numEvents, drumgpu::kMaxExcitations), whichDrum, drumInput));
+
+	// Warps with every mode disabled (e.g. above Nyquist) contribute silence.
+	if (__all_sync(0xffffffff, !(mi->flags[i] & drumgpu::kModeEnabled))) {
+		for (int samp = i % 32; samp < BUFFERSIZE * 2; samp += 32) {
+			output[whichwarp * (BUFFERSIZE * 2) + samp] = 0.0f;
+		}
+		yprev[2 * i] = y.x;
+		yprev[2 * i + 1] = y.y;
+		return;
 	}
 
-	int whichDrum = (int)(i / 1024);
 	float pan = drumInfo[whichDrum * 8 + 0];
 
-	const float *input_base = input + (BUFFERSIZE*whichDrum);
+	if (!driven) {
+		y = renderUndrivenWarp(y, log_pole, pan, output + whichwarp * (BUFFERSIZE * 2));
+		yprev[2 * i] = y.x;
+		yprev[2 * i + 1] = y.y;
+		addWarpEnergy(y, &bankEnergy[whichDrum]);
+		return;
+	}
+
 	// Main loop - spin for enough cycles to generate the whole buffer.
 	for (int samp = 0; samp < BUFFERSIZE; samp++) {
 		y = cuCmulf(exp_term, y);
-		// Always assume input is present -- host will set amplitude to 0 when not.
-		// This could be optimized with an "input present" flag given it's usually 0.
-		input_complex.x = input_base[samp];
+		input_complex.x = drumInput[samp];
 		input_complex.y = 0.0f;
 		y = cuCaddf(y, cuCmulf(input_complex, input_amp));
 
@@ -129,42 +197,370 @@ __global__ void filterbankKernel(float *yprev, const ModeInfo *mi, const float*
 	// Save state back to shared/global memory for next kernel invocation.
 	yprev[2 * i] = y.x;
 	yprev[2 * i + 1] = y.y;
+	addWarpEnergy(y, &bankEnergy[whichDrum]);
 }
 
-int main()
-{
-	HANDLE hMapFile = CreateFileMapping(
-		INVALID_HANDLE_VALUE, // use paging file,
-		NULL, // default security
-		PAGE_READWRITE,
-		0, // max objeect size (high-order)
-		SHAREDMEMSIZE,  // max obj size (low-order),
-		szName);
-	if (hMapFile == nullptr) {
-		fprintf(stderr, "shared memory init failed! %d", GetLastError());
+// Second stage: sum the numWarps per-warp outputs into the final interleaved block, so only that
+// block is copied back to the host. Each thread column owns one output sample and accumulates a
+// stride of warps (coalesced across the column); the rows are then tree-summed in shared memory.
+__global__ void reduceWarpsKernel(const float* warpOutput, float* output, int numWarps) {
+	__shared__ float partial[REDUCE_ROWS][REDUCE_COLS + 1];  // +1 avoids bank conflicts.
+	int samp = blockIdx.x * REDUCE_COLS + threadIdx.x;
+
+	float sum = 0.0f;
+	for (int w = threadIdx.y; w < numWarps; w += REDUCE_ROWS) {
+		sum += warpOutput[w * (BUFFERSIZE * 2) + samp];
+	}
+	partial[threadIdx.y][threadIdx.x] = sum;
+	__syncthreads();
+
+	for (int rows = REDUCE_ROWS / 2; rows > 0; rows /= 2) {
+		if (threadIdx.y < rows) {
+			partial[threadIdx.y][threadIdx.x] += partial[threadIdx.y + rows][threadIdx.x];
+		}
+		__syncthreads();
+	}
+	if (threadIdx.y == 0) {
+		output[samp] = partial[0][threadIdx.x];
+	}
+}
+
+// ----- Persistent mode -----
+// With DRUM_GPU_PERSISTENT=1, one launch serves every job using the doorbell protocol in
+// Doorbell.h. The shared region is registered as mapped host memory: the kernel polls the ring
+// head there, reads each job's changed modes and input in place, and writes the output back, so
+// there are no per-block copies, launches or synchronizations.
+// Each block renders one bank, and resonator state stays in registers between jobs; the grid is
+// as many banks as fit on the GPU at once. Banks that have decayed below kBankSleepEnergy skip
+// the recurrence until their next hit. The kernel never returns, so the GPU must not be
+// subject to a display watchdog.
+
+__device__ __forceinline__ uint32_t loadVolatile(const uint32_t* p) {
+	return *(const volatile uint32_t*)p;
+}
+
+__global__ void persistentFilterbankKernel(char* region, uint32_t firstJob, float* warpOutput, float* drumOutput, unsigned int* drumsDone) {
+	__shared__ float drumInput[BUFFERSIZE];
+	__shared__ bool quit;
+	__shared__ bool lastDrum;
+	__shared__ float bankEnergy;  // Sum of |y|^2 after the bank was last rendered.
+	__shared__ float energySum;
+	// The current job's header, copied out of mapped host memory once per job.
+	__shared__ drumgpu::ModeRange jobRanges[drumgpu::kMaxModeRanges];
+	__shared__ uint32_t jobNumRanges;
+	__shared__ uint32_t jobNumBanks;
+	__shared__ float jobPan;
+	__shared__ drumgpu::Excitation bankEvents[drumgpu::kMaxExcitations];  // This bank's, in order.
+	__shared__ int numBankEvents;
+
+	int i = threadIdx.x + blockIdx.x * blockDim.x;
+	int whichwarp = (int)(i / 32);
+	bool is_first_thread_in_warp = (i % 32) == 0;
+	int whichDrum = blockIdx.x;
+	int warpsPerDrum = blockDim.x / 32;
+
+	drumgpu::ControlBlock* control = drumgpu::RegionView::map(region).control;
+	const uint32_t* head = (const uint32_t*)&control->head;
+	uint32_t* rendered = (uint32_t*)&control->rendered;
+	uint32_t ringSlots = loadVolatile(&control->ringSlots);
+
+	cuComplex y = make_cuComplex(0.0f, 0.0f);
+	cuComplex input_amp = make_cuComplex(0.0f, 0.0f);
+	cuComplex log_pole = make_cuComplex(0.0f, 0.0f);
+	cuComplex exp_term = make_cuComplex(0.0f, 0.0f);
+	bool enabled = false;
+	if (threadIdx.x == 0) {
+		bankEnergy = 0.0f;
+	}
+
+	for (uint32_t job = firstJob;; job++) {
+		// Wait for the plugin to publish this job, and for the previous one to be written out.
+		if (threadIdx.x == 0) {
+			while ((loadVolatile(head) == job || loadVolatile(rendered) != job) &&
+				loadVolatile(&control->magic) == drumgpu::kControlMagic) {
+#if __CUDA_ARCH__ >= 700
+				__nanosleep(256);
+#endif
+			}
+			quit = loadVolatile(&control->magic) != drumgpu::kControlMagic;
+			__threadfence_system();
+		}
+		__syncthreads();
+		if (quit) {
+			return;
+		}
+
+		// Read through volatile pointers: slots are reused, so nothing may be cached across jobs.
+		drumgpu::RegionView shared = drumgpu::RegionView::map(region, job % ringSlots);
+		const volatile ModeTable* mi = shared.modes;
+
+		// Every thread needs the job's header and its bank's events, but each read of mapped memory
+		// crosses the bus: the first warp copies them to shared memory and the block reads the copy.
+		if (threadIdx.x < 32) {
+			const volatile drumgpu::ModeUpdates* updates = shared.updates;
+			const uint32_t numRanges = min(updates->numRanges, (uint32_t)drumgpu::kMaxModeRanges);
+			for (uint32_t r = threadIdx.x; r < numRanges; r += 32) {
+				jobRanges[r].first = updates->ranges[r].first;
+				jobRanges[r].count = updates->ranges[r].count;
+			}
+			// Keep only this bank's events. Lanes test 32 events at a time, and the ballot
+			// places the matches in event order, as the other engines sum them.
+			const volatile drumgpu::ExcitationList* excitations = shared.excitations;
+			const int numEvents = min((int)excitations->numEvents, drumgpu::kMaxExcitations);
+			int found = 0;
+			for (int base = 0; base < numEvents; base += 32) {
+				const int e = base + threadIdx.x;
+				const bool mine = e < numEvents && excitations->events[e].bank == (uint32_t)whichDrum;
+				const unsigned int matches = __ballot_sync(0xffffffff, mine);
+				if (mine) {
+					const volatile drumgpu::Excitation& ev = excitations->events[e];
+					drumgpu::Excitation& event = bankEvents[found + __popc(matches & ((1u << threadIdx.x) - 1))];
+					event.bank = ev.bank;
+					event.shape = ev.shape;
+					event.start = ev.start;
+					event.length = ev.length;
+					event.slope = ev.slope;
+				}
+				found += __popc(matches);
+			}
+			if (threadIdx.x == 0) {
+				numBankEvents = found;
+				jobNumRanges = numRanges;
+				jobNumBanks = updates->numBanks;
+				jobPan = ((const volatile float*)shared.drumInfo)[whichDrum * 8 + 0];
+			}
+		}
+		__syncthreads();
+		const uint32_t numBanks = jobNumBanks;
+		bool active = (uint32_t)whichDrum < numBanks;
+
+		// Reload this mode if the plugin rewrote it for this job.
+		for (uint32_t r = 0; r < jobNumRanges; r++) {
+			uint32_t first = jobRanges[r].first;
+			if ((uint32_t)i >= first && (uint32_t)i < first + jobRanges[r].count) {
+				if (mi->flags[i] & drumgpu::kModeReset) {
+					y.x = 0.0f;
+					y.y = 0.0f;
+				}
+				enabled = (mi->flags[i] & drumgpu::kModeEnabled) != 0;
+				input_amp.x = mi->ampRe[i];
+				input_amp.y = mi->ampRe[i];
+				log_pole.x = -mi->damp[i];
+				log_pole.y = mi->freq[i];
+				exp_term = custom_cexpf(log_pole);
+			}
+		}
+
+		bool hit = synthesizeInput(bankEvents, numBankEvents, whichDrum, drumInput);
+		const float pan = jobPan;
+		if (threadIdx.x == 0) {
+			energySum = 0.0f;
+		}
+		// Sleeping banks wake when hit.
+		hit = __syncthreads_or(hit);
+		const bool awake = active && (hit || bankEnergy >= drumgpu::kBankSleepEnergy);
+
+		// Same recurrence and warp sum as filterbankKernel, including skipping silent warps and
+		// the closed form for blocks without input.
+		cuComplex input_complex;
+		const bool warpSilent = !awake || __all_sync(0xffffffff, !enabled);
+		for (int samp = i % 32; awake && warpSilent && samp < BUFFERSIZE * 2; samp += 32) {
+			warpOutput[whichwarp * (BUFFERSIZE * 2) + samp] = 0.0f;
+		}
+		if (!warpSilent && !hit) {
+			y = renderUndrivenWarp(y, log_pole, pan, warpOutput + whichwarp * (BUFFERSIZE * 2));
+		}
+		for (int samp = 0; !warpSilent && hit && samp < BUFFERSIZE; samp++) {
+			y = cuCmulf(exp_term, y);
+			input_complex.x = drumInput[samp];
+			input_complex.y = 0.0f;
+			y = cuCaddf(y, cuCmulf(input_complex, input_amp));
+
+			float merge_output_L = y.x*pan;
+			float merge_output_R = y.x*(1-pan);
+			for (int offset = 16; offset > 0; offset /= 2) {
+				merge_output_L += __shfl_down_sync(0xffffffff, merge_output_L, offset);
+				merge_output_R += __shfl_down_sync(0xffffffff, merge_output_R, offset);
+			}
+			if (is_first_thread_in_warp) {
+				warpOutput[whichwarp * (BUFFERSIZE*2) + 2*samp] = merge_output_L;
+				warpOutput[whichwarp * (BUFFERSIZE * 2) + 2*samp + 1] = merge_output_R;
+			}
+		}
+		if (!warpSilent) {
+			addWarpEnergy(y, &energySum);
+		}
+		__syncthreads();
+		if (awake && threadIdx.x == 0) {
+			bankEnergy = energySum;
+		}
+
+		// Sum this drum's warps.
+		for (int samp = threadIdx.x; samp < BUFFERSIZE * 2; samp += blockDim.x) {
+			float sum = 0.0f;
+			for (int w = 0; awake && w < warpsPerDrum; w++) {
+				sum += warpOutput[(whichDrum * warpsPerDrum + w) * (BUFFERSIZE * 2) + samp];
+			}
+			drumOutput[whichDrum * (BUFFERSIZE * 2) + samp] = sum;
+		}
+
+		// The last bank to finish sums every active bank into the slot's output and publishes the job.
+		__threadfence();
+		__syncthreads();
+		if (threadIdx.x == 0) {
+			lastDrum = atomicAdd(drumsDone, 1) == gridDim.x - 1;
+		}
+		__syncthreads();
+		if (lastDrum) {
+			const volatile float* drums = drumOutput;
+			for (int samp = threadIdx.x; samp < BUFFERSIZE * 2; samp += blockDim.x) {
+				float sum = 0.0f;
+				for (int d = 0; d < (int)min(numBanks, gridDim.x); d++) {
+					sum += drums[d * (BUFFERSIZE * 2) + samp];
+				}
+				shared.output[samp] = sum;
+			}
+			__threadfence_system();
+			__syncthreads();
+			if (threadIdx.x == 0) {
+				*drumsDone = 0;
+				__threadfence_system();
+				*(volatile uint32_t*)rendered = job + 1;
+			}
+		}
+	}
+}
+
+// Stage timings are published to the region's stats page about once a second. With
+// DRUM_GPU_STATS_LOG=n they are also printed every n seconds.
+static int statsLogInterval() {
+	const char* interval = getenv("DRUM_GPU_STATS_LOG");
+	return interval != nullptr ? atoi(interval) : 0;
+}
+
+static double eventSeconds(cudaEvent_t from, cudaEvent_t to) {
+	float ms = 0.0f;
+	cudaEventElapsedTime(&ms, from, to);
+	return ms * 1e-3;
+}
+
+static int runPersistent(drumgpu::SharedMemoryRegion& region) {
+	cudaError_t cudaStatus;
+
+	// Every bank's block has to be resident at once, or the last-bank handoff never happens. We
+	// offer the plugin as many banks as fit, and need at least one per drum.
+	int device = 0;
+	int numSMs = 0;
+	int blocksPerSM = 0;
+	cudaGetDevice(&device);
+	cudaDeviceGetAttribute(&numSMs, cudaDevAttrMultiProcessorCount, device);
+	cudaOccupancyMaxActiveBlocksPerMultiprocessor(&blocksPerSM, persistentFilterbankKernel, drumgpu::kModesPerDrum, 0);
+	int maxBanks = min(numSMs * blocksPerSM, MAXBANKS);
+	if (maxBanks < NDRUMS) {
+		fprintf(stderr, "Persistent mode needs %d resident blocks; this GPU fits %d.\n", NDRUMS, maxBanks);
 		return 1;
 	}
-	LPCTSTR pBuf = (LPTSTR)MapViewOfFile(hMapFile,
-		FILE_MAP_ALL_ACCESS,
-		0,
-		0,
-		SHAREDMEMSIZE);
-	if (pBuf == nullptr) {
-		fprintf(stderr, "mapviewoffile failed! %d", GetLastError());
-		CloseHandle(hMapFile);
+	region.view().control->maxBanks = maxBanks;
+
+	cudaStatus = cudaHostRegister(region.getAddr(), drumgpu::kSharedMemSizeBytes, cudaHostRegisterMapped);
+	if (cudaStatus != cudaSuccess) {
+		fprintf(stderr, "cudaHostRegister shared memory failed: %s\n", cudaGetErrorString(cudaStatus));
+		return 1;
+	}
+	char* dev_region;
+	cudaStatus = cudaHostGetDevicePointer((void**)&dev_region, region.getAddr(), 0);
+	if (cudaStatus != cudaSuccess) {
+		fprintf(stderr, "cudaHostGetDevicePointer failed: %s\n", cudaGetErrorString(cudaStatus));
 		return 1;
 	}
 
-	HANDLE hSemaphore = CreateSemaphoreA(NULL, 0, 1, szNameSemaphore);
-	if (hSemaphore == nullptr) {
-		fprintf(stderr, "could not create semaphore %d", GetLastError());
-		CloseHandle(hMapFile);
+	float* dev_output_samps;  // output samples, per-warp
+	float* dev_drum_output;  // output samples, per-bank
+	unsigned int* dev_drums_done;  // banks finished with the current job
+	cudaStatus = cudaMalloc((void**)&dev_output_samps, maxBanks * WARPS_PER_BANK * 2 * BUFFERSIZE * sizeof(float));
+	if (cudaStatus != cudaSuccess) {
+		fprintf(stderr, "cudaMalloc output_samps failed!");
+		return 1;
+	}
+	cudaStatus = cudaMalloc((void**)&dev_drum_output, maxBanks * 2 * BUFFERSIZE * sizeof(float));
+	if (cudaStatus != cudaSuccess) {
+		fprintf(stderr, "cudaMalloc drum_output failed!");
 		return 1;
 	}
-	HANDLE hSemaphoreGPU = CreateSemaphoreA(NULL, 0, 1, szNameSemaphoreGPU);
-	if (hSemaphore == nullptr) {
-		fprintf(stderr, "could not create semaphore-gpu %d", GetLastError());
-		CloseHandle(hMapFile);
+	cudaStatus = cudaMalloc((void**)&dev_drums_done, sizeof(unsigned int));
+	if (cudaStatus == cudaSuccess) {
+		cudaStatus = cudaMemset(dev_drums_done, 0, sizeof(unsigned int));
+	}
+	if (cudaStatus != cudaSuccess) {
+		fprintf(stderr, "cudaMalloc drums_done failed!");
+		return 1;
+	}
+
+	drumgpu::ControlBlock* control = region.view().control;
+	uint32_t firstJob = control->tail.load(std::memory_order_relaxed);
+	control->rendered.store(firstJob, std::memory_order_release);
+	persistentFilterbankKernel << <maxBanks, drumgpu::kModesPerDrum>> > (dev_region, firstJob, dev_output_samps, dev_drum_output, dev_drums_done);
+	cudaStatus = cudaGetLastError();
+	if (cudaStatus != cudaSuccess) {
+		fprintf(stderr, "Kernel launch failed: %s\n", cudaGetErrorString(cudaStatus));
+		return 1;
+	}
+
+	// The host only sees each job's hand-off, so that is all it can time.
+	drumgpu::ServerStatsRecorder stats(region.view().stats);
+	stats.setLogInterval(statsLogInterval());
+	fprintf(stderr, "gpuaudio kernel process: persistent kernel running. Ctrl-C to exit.\n");
+	while (true) {
+		drumgpu::forwardRenderedJob(region, &stats);
+	}
+	return 0;
+}
+
+// Device buffers sized per bank. They start with one bank per drum and grow when a job asks for
+// more voices, carrying the resonator state of the existing banks over.
+struct BankBuffers {
+	int banks = 0;
+	float* previousvalues = nullptr;  // previous values of exponential across kernel launches. Interleaved complex.
+	float* druminfo = nullptr;  // drum info, per-bank
+	float* output_samps = nullptr;  // output samples, per-warp
+};
+
+static bool growBankBuffers(BankBuffers& buffers, int banks) {
+	if (banks <= buffers.banks) {
+		return true;
+	}
+	BankBuffers grown;
+	grown.banks = banks;
+	cudaError_t cudaStatus = cudaMalloc((void**)&grown.previousvalues, banks * drumgpu::kModesPerDrum * 2 * sizeof(float));
+	if (cudaStatus == cudaSuccess) {
+		cudaStatus = cudaMemset(grown.previousvalues, 0, banks * drumgpu::kModesPerDrum * 2 * sizeof(float));
+	}
+	if (cudaStatus == cudaSuccess && buffers.banks > 0) {
+		cudaStatus = cudaMemcpy(grown.previousvalues, buffers.previousvalues,
+			buffers.banks * drumgpu::kModesPerDrum * 2 * sizeof(float), cudaMemcpyDeviceToDevice);
+	}
+	if (cudaStatus == cudaSuccess) {
+		cudaStatus = cudaMalloc((void**)&grown.druminfo, banks * drumgpu::kDrumInfoStride * sizeof(float));
+	}
+	if (cudaStatus == cudaSuccess) {
+		cudaStatus = cudaMalloc((void**)&grown.output_samps, banks * WARPS_PER_BANK * 2 * BUFFERSIZE * sizeof(float));
+	}
+	if (cudaStatus != cudaSuccess) {
+		fprintf(stderr, "cudaMalloc for %d banks failed: %s\n", banks, cudaGetErrorString(cudaStatus));
+		return false;
+	}
+	cudaFree(buffers.previousvalues);
+	cudaFree(buffers.druminfo);
+	cudaFree(buffers.output_samps);
+	buffers = grown;
+	return true;
+}
+
+int main()
+{
+	drumgpu::SharedMemoryRegion region;
+	if (!region.create()) {
+		fprintf(stderr, "shared memory init failed!\n");
 		return 1;
 	}
 
@@ -176,70 +572,182 @@ int main()
 		return 1;
 	}
 
-	float* dev_previousvalues; // previous values of exponential across kernel launches. Interleaved complex.
-	int* dev_modeinfo;  // modeinfo, per-drum.
-	float* dev_druminfo;  // drum info, per-drum
-	float* dev_inputs;  // input signals, per-drum
-	float* dev_output_samps;  // output samples, per-warp
-	
-	cudaStatus = cudaMalloc((void**)&dev_previousvalues, NMODES * 2 * sizeof(float));
-	if (cudaStatus != cudaSuccess) {
-		fprintf(stderr, "cudaMalloc dev_previousvalues failed!");
-		return 1;
+	if (const char* persistent = getenv("DRUM_GPU_PERSISTENT")) {
+		if (atoi(persistent) != 0) {
+			return runPersistent(region);
+		}
 	}
-	cudaStatus = cudaMalloc((void**)&dev_modeinfo, NMODES * sizeof(ModeInfo));
+
+	ModeTable* dev_modeinfo;  // mode parameters, per-mode planes.
+	float* dev_output;  // output samples, reduced. Interleaved stereo.
+	drumgpu::ExcitationList* dev_excitations;  // hit events of the current job.
+	int* dev_bank_list;  // banks awake for the current job, one per kernel block.
+	float* dev_bank_energy;  // sum of |y|^2 per bank after the current job.
+	BankBuffers banks;  // per-bank buffers, grown to the banks jobs use.
+
+	cudaStatus = cudaMalloc((void**)&dev_modeinfo, sizeof(ModeTable));
 	if (cudaStatus != cudaSuccess) {
 		fprintf(stderr, "cudaMalloc dev_modeinfo failed!");
 		return 1;
 	}
-	// 8 params per drum
-	cudaStatus = cudaMalloc((void**)&dev_druminfo, NDRUMS * sizeof(float) * 8);
+	cudaStatus = cudaMalloc((void**)&dev_output, 2 * BUFFERSIZE * sizeof(float));
 	if (cudaStatus != cudaSuccess) {
-		fprintf(stderr, "cudaMalloc dev_druminfo failed!");
+		fprintf(stderr, "cudaMalloc output failed!");
 		return 1;
 	}
-	cudaStatus = cudaMalloc((void**)&dev_inputs, NDRUMS * BUFFERSIZE * sizeof(float));
+	cudaStatus = cudaMalloc((void**)&dev_excitations, sizeof(drumgpu::ExcitationList));
 	if (cudaStatus != cudaSuccess) {
-		fprintf(stderr, "cudaMalloc dev_inputs failed!");
+		fprintf(stderr, "cudaMalloc excitations failed!");
 		return 1;
 	}
-	cudaStatus = cudaMalloc((void**)&dev_output_samps, NWARPS * 2 * BUFFERSIZE * sizeof(float));
+	cudaStatus = cudaMalloc((void**)&dev_bank_list, MAXBANKS * sizeof(int));
+	if (cudaStatus == cudaSuccess) {
+		cudaStatus = cudaMalloc((void**)&dev_bank_energy, MAXBANKS * sizeof(float));
+	}
 	if (cudaStatus != cudaSuccess) {
-		fprintf(stderr, "cudaMalloc output_samps failed!");
+		fprintf(stderr, "cudaMalloc bank list failed!");
+		return 1;
+	}
+	if (!growBankBuffers(banks, NDRUMS)) {
 		return 1;
 	}
 
 	int times = 0;
+	// Last mode generation applied per bank.
+	uint32_t bankGeneration[MAXBANKS] = {};
+	// Energy of each bank after it was last rendered. Banks below kBankSleepEnergy are asleep:
+	// they aren't launched until their input has a hit.
+	float bankEnergy[MAXBANKS] = {};
+	float jobEnergy[MAXBANKS];
+	int bankList[MAXBANKS];
 	
-	int* sharedmem_modeinfoptr = (int*)pBuf;
-	int* sharedmem_druminfoptr = (int*)((char*)sharedmem_modeinfoptr + NMODES * sizeof(ModeInfo));
-	int* sharedmem_inputptr = (int*)((char*)sharedmem_druminfoptr + NDRUMS*8*sizeof(float));
-	int* sharedmem_outputptr = (int*)((char*)sharedmem_inputptr + NDRUMS * BUFFERSIZE * sizeof(float));
+	// Device stages are timed between events on the default stream: upload from begin to uploaded,
+	// the filterbank kernel to launched, the reduction to reduced, and the copies back from
+	// downloadBegin to downloaded. Host time blocked in between is the sync stage.
+	enum { kEvBegin, kEvUploaded, kEvLaunched, kEvReduced, kEvDownloadBegin, kEvDownloaded, kNumEvents };
+	cudaEvent_t events[kNumEvents];
+	for (cudaEvent_t& event : events) {
+		cudaStatus = cudaEventCreate(&event);
+		if (cudaStatus != cudaSuccess) {
+			fprintf(stderr, "cudaEventCreate failed!");
+			return 1;
+		}
+	}
+	drumgpu::ServerStatsRecorder stats(region.view().stats);
+	stats.setLogInterval(statsLogInterval());
+
+	drumgpu::ControlBlock* control = region.view().control;
 	fprintf(stderr, "gpuaudio kernel process: starting main loop. Ctrl-C to exit.\n");
 	while (true) {
 		times++;
-		WaitForSingleObject(hSemaphore, INFINITE);
-
-		// Copy modes from shared memory to device.
-		cudaStatus = cudaMemcpy(dev_modeinfo, sharedmem_modeinfoptr, NMODES * sizeof(ModeInfo), cudaMemcpyHostToDevice);
-		if (cudaStatus != cudaSuccess) {
-			fprintf(stderr, "cudaMemcpy modeinfos failed!");
+		region.waitCPU();
+		const auto jobStart = drumgpu::ServerStatsRecorder::Clock::now();
+		cudaEventRecord(events[kEvBegin]);
+
+		// Next job in the block ring. The plugin may already be filling the following slots.
+		uint32_t job = control->tail.load(std::memory_order_relaxed);
+		drumgpu::RegionView shared = region.view(job % drumgpu::kRingSlots);
+		ModeTable* sharedmem_modeinfoptr = shared.modes;
+		float* sharedmem_druminfoptr = shared.drumInfo;
+		const drumgpu::ExcitationList* sharedmem_excitations = shared.excitations;
+		float* sharedmem_outputptr = shared.output;
+
+		// Copy only the modes the plugin rewrote for this job; dev_modeinfo keeps the rest.
+		const drumgpu::ModeUpdates* updates = shared.updates;
+		const int numBanks = min((int)updates->numBanks, MAXBANKS);
+		if (!growBankBuffers(banks, numBanks)) {
 			return 1;
 		}
-		cudaStatus = cudaMemcpy(dev_druminfo, sharedmem_druminfoptr, NDRUMS * 8*sizeof(float), cudaMemcpyHostToDevice);
+		// Only the kernel applies kModeReset, so a bank with a reset in its updates is launched
+		// even if asleep; otherwise its old state would be left to ring into the next hit.
+		bool reset[MAXBANKS] = {};
+		for (uint32_t r = 0; r < updates->numRanges && r < drumgpu::kMaxModeRanges; r++) {
+			const drumgpu::ModeRange range = updates->ranges[r];
+			if (range.first + range.count > (uint32_t)NMODES) {
+				continue;
+			}
+			for (uint32_t m = range.first; m < range.first + range.count; m++) {
+				if (sharedmem_modeinfoptr->flags[m] & drumgpu::kModeReset) {
+					reset[m / drumgpu::kModesPerDrum] = true;
+				}
+			}
+			// Same range in each plane.
+			const size_t planeOffsets[] = {offsetof(ModeTable, freq), offsetof(ModeTable, damp),
+				offsetof(ModeTable, ampRe), offsetof(ModeTable, ampIm)};
+			for (size_t planeOffset : planeOffsets) {
+				const size_t offset = planeOffset + range.first * sizeof(float);
+				cudaStatus = cudaMemcpy((char*)dev_modeinfo + offset, (const char*)sharedmem_modeinfoptr + offset,
+					range.count * sizeof(float), cudaMemcpyHostToDevice);
+				if (cudaStatus != cudaSuccess) {
+					fprintf(stderr, "cudaMemcpy modeinfos failed!");
+					return 1;
+				}
+			}
+			cudaStatus = cudaMemcpy(dev_modeinfo->flags + range.first, sharedmem_modeinfoptr->flags + range.first,
+				range.count, cudaMemcpyHostToDevice);
+			if (cudaStatus != cudaSuccess) {
+				fprintf(stderr, "cudaMemcpy modeinfos failed!");
+				return 1;
+			}
+		}
+		for (int banki = 0; banki < numBanks; banki++) {
+			// Each rewrite bumps the generation once; a larger step means a job was missed.
+			// (A new plugin instance restarts from 1, which shows up as a backwards step.)
+			uint32_t step = updates->bankGeneration[banki] - bankGeneration[banki];
+			if (step > 1 && step < 0x80000000u) {
+				fprintf(stderr, "mode updates for bank %d skipped generations %u..%u\n", banki,
+					bankGeneration[banki] + 1, updates->bankGeneration[banki] - 1);
+			}
+			bankGeneration[banki] = updates->bankGeneration[banki];
+		}
+		cudaStatus = cudaMemcpy(banks.druminfo, sharedmem_druminfoptr, numBanks * 8*sizeof(float), cudaMemcpyHostToDevice);
 		if (cudaStatus != cudaSuccess) {
 			fprintf(stderr, "cudaMemcpy drumInfos failed!");
 			return 1;
 		}
-		cudaStatus = cudaMemcpy(dev_inputs, sharedmem_inputptr, NDRUMS * BUFFERSIZE * sizeof(float), cudaMemcpyHostToDevice);
+		// Only the events are uploaded; the kernel synthesizes the input.
+		const int numEvents = min((int)sharedmem_excitations->numEvents, drumgpu::kMaxExcitations);
+		cudaStatus = cudaMemcpy(dev_excitations, sharedmem_excitations,
+			offsetof(drumgpu::ExcitationList, events) + numEvents * sizeof(drumgpu::Excitation), cudaMemcpyHostToDevice);
 		if (cudaStatus != cudaSuccess) {
-			fprintf(stderr, "cudaMemcpy inputs failed!");
+			fprintf(stderr, "cudaMemcpy excitations failed!");
 			return 1;
 		}
 
+		bool hit[MAXBANKS] = {};
+		for (int e = 0; e < numEvents; e++) {
+			if (sharedmem_excitations->events[e].bank < (uint32_t)numBanks) {
+				hit[sharedmem_excitations->events[e].bank] = true;
+			}
+		}
+		int numAwake = 0;
+		for (int banki = 0; banki < numBanks; banki++) {
+			if (hit[banki] || reset[banki] || bankEnergy[banki] >= drumgpu::kBankSleepEnergy) {
+				bankList[numAwake++] = banki;
+			}
+		}
+		if (numAwake > 0) {
+			cudaStatus = cudaMemcpy(dev_bank_list, bankList, numAwake * sizeof(int), cudaMemcpyHostToDevice);
+			if (cudaStatus == cudaSuccess) {
+				cudaStatus = cudaMemset(dev_bank_energy, 0, numBanks * sizeof(float));
+			}
+			if (cudaStatus != cudaSuccess) {
+				fprintf(stderr, "cudaMemcpy bank list failed!");
+				return 1;
+			}
+		}
+
+		cudaEventRecord(events[kEvUploaded]);
+
 		// Kernel launch
-		// NMODES total. (10 drums * 1024)
-		filterbankKernel << <10, 1024>> > (dev_previousvalues, (ModeInfo*)dev_modeinfo, dev_druminfo, dev_inputs, dev_output_samps);
+		// One block of 1024 modes per awake bank.
+		if (numAwake > 0) {
+			filterbankKernel << <numAwake, drumgpu::kModesPerDrum>> > (banks.previousvalues, dev_modeinfo, banks.druminfo, dev_excitations, banks.output_samps,
+				dev_bank_list, dev_bank_energy);
+		}
+		cudaEventRecord(events[kEvLaunched]);
+		reduceWarpsKernel << <(BUFFERSIZE * 2) / REDUCE_COLS, dim3(REDUCE_COLS, REDUCE_ROWS)>> > (banks.output_samps, dev_output, numAwake * WARPS_PER_BANK);
+		cudaEventRecord(events[kEvReduced]);
 
 		// Check for any errors launching the kernel
 		cudaStatus = cudaGetLastError();
@@ -250,32 +758,45 @@ int main()
 
 		// cudaDeviceSynchronize waits for the kernel to finish, and returns
 		// any errors encountered during the launch.
+		const auto syncStart = drumgpu::ServerStatsRecorder::Clock::now();
 		cudaStatus = cudaDeviceSynchronize();
+		const double syncSeconds = drumgpu::ServerStatsRecorder::secondsSince(syncStart);
 		if (cudaStatus != cudaSuccess) {
 			fprintf(stderr, "cudaDeviceSynchronize returned error code %d after launching kernel!\n", cudaStatus);
 			return 1;
 		}
 		
-		// Copy output vector from GPU buffer to host memory.
-		cudaStatus = cudaMemcpy(host_samplebuffer, dev_output_samps, BUFFERSIZE*NWARPS*2*sizeof(float), cudaMemcpyDeviceToHost);
+		// Copy the reduced output block straight into shared memory.
+		cudaEventRecord(events[kEvDownloadBegin]);
+		cudaStatus = cudaMemcpy(sharedmem_outputptr, dev_output, BUFFERSIZE*2*sizeof(float), cudaMemcpyDeviceToHost);
 		if (cudaStatus != cudaSuccess) {
 			fprintf(stderr, "cudaMemcpy samples-back failed!");
 			return 1;
 		}
-
-		// Sum up and output to buffer
-		float* sampsBuf = ((float*)sharedmem_outputptr);
-		for (int samplei = 0; samplei < BUFFERSIZE; samplei++) {
-			float sampleL = 0.0f;
-			float sampleR = 0.0f;
-			for (int j = 0; j < NWARPS; j++) {
-				sampleL += host_samplebuffer[j*(BUFFERSIZE*2) + 2*samplei + 0];
-				sampleR += host_samplebuffer[j *(BUFFERSIZE*2) + 2 * samplei + 1];
+		if (numAwake > 0) {
+			cudaStatus = cudaMemcpy(jobEnergy, dev_bank_energy, numBanks * sizeof(float), cudaMemcpyDeviceToHost);
+			if (cudaStatus != cudaSuccess) {
+				fprintf(stderr, "cudaMemcpy bank energy failed!");
+				return 1;
+			}
+			for (int a = 0; a < numAwake; a++) {
+				bankEnergy[bankList[a]] = jobEnergy[bankList[a]];
 			}
-			sampsBuf[2*samplei+0] = sampleL;
-			sampsBuf[2*samplei+1] = sampleR;
 		}
-		ReleaseSemaphore(hSemaphoreGPU, 1, NULL);
+		cudaEventRecord(events[kEvDownloaded]);
+		const double jobSeconds = drumgpu::ServerStatsRecorder::secondsSince(jobStart);
+		control->tail.store(job + 1, std::memory_order_release);
+		region.signalGPU();
+
+		// The output is handed back; the rest is off the plugin's clock.
+		cudaEventSynchronize(events[kEvDownloaded]);
+		stats.record(drumgpu::kServerUpload, eventSeconds(events[kEvBegin], events[kEvUploaded]));
+		stats.record(drumgpu::kServerKernel, eventSeconds(events[kEvUploaded], events[kEvLaunched]));
+		stats.record(drumgpu::kServerReduce, eventSeconds(events[kEvLaunched], events[kEvReduced]));
+		stats.record(drumgpu::kServerSync, syncSeconds);
+		stats.record(drumgpu::kServerDownload, eventSeconds(events[kEvDownloadBegin], events[kEvDownloaded]));
+		stats.record(drumgpu::kServerTotal, jobSeconds);
+		stats.endJob((uint64_t)numAwake * drumgpu::kModesPerDrum * BUFFERSIZE);
 	}
     return 0;
 }
@@ -0,0 +1,75 @@
+// Adapts host blocks of any size to the engine's fixed kBufferSize quantum.
+//
+// Host input (MIDI, in the plugin) is gathered until it completes a quantum, which is then
+// rendered into a FIFO that the host's output is served from. Output lags input by a fixed
+// latency: the least that keeps the FIFO from running dry at the host's block size. For a fixed
+// block size n that is kBufferSize - gcd(n, kBufferSize), so 0 for multiples of the quantum,
+// 192 samples at 64 and 128 at 128.
+//
+// Hosts may send smaller blocks than they announced. If one arrives that the latency doesn't
+// cover, the adapter inserts silence once to move to the worst case, kBufferSize - 1, which
+// covers any sequence of block sizes.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+
+#include "JuceGPUDrum/SharedLayout.h"
+
+namespace drumgpu {
+
+class BlockAdapter {
+   public:
+    static constexpr int kQuantum = kBufferSize;
+
+    // Empty the FIFO and set the latency for hosts delivering |blockSize| samples per block.
+    void prepare(int blockSize);
+
+    int getLatencySamples() const { return latency; }
+
+    // Serve |numSamples| of output into |left| and |right| (which may be null).
+    // |render(inputEnd, quantum)| is called for each quantum the block's input completes, in
+    // order: the block's input before sample |inputEnd| belongs to it (with any left over from
+    // earlier blocks), and it writes 2 * kQuantum interleaved stereo samples to |quantum|.
+    // Returns true if the latency grew and should be reported again.
+    template <typename Render>
+    bool process(int numSamples, float* left, float* right, Render&& render) {
+        bool grew = false;
+        int done = 0;
+        while (done < numSamples) {
+            const int take = std::min(numSamples - done, kQuantum - inputFill);
+            inputFill += take;
+            if (inputFill == kQuantum) {
+                render(done + take, quantum.data());
+                push(quantum.data(), kQuantum);
+                inputFill = 0;
+            }
+            if (fill < take) {
+                pushSilence(kQuantum - 1 - latency);
+                latency = kQuantum - 1;
+                grew = true;
+            }
+            pop(take, left ? left + done : nullptr, right ? right + done : nullptr);
+            done += take;
+        }
+        return grew;
+    }
+
+   private:
+    // Holds at most latency + kQuantum frames, just before a pop.
+    static constexpr int kCapacity = 2 * kQuantum;
+
+    void push(const float* frames, int count);
+    void pushSilence(int count);
+    void pop(int count, float* left, float* right);
+
+    std::array<float, 2 * kQuantum> quantum{};
+    std::array<float, 2 * kCapacity> fifo{};  // Interleaved stereo frames.
+    int readPos = 0;
+    int fill = 0;
+    int inputFill = 0;  // Samples of the next quantum's input gathered so far.
+    int latency = 0;
+};
+
+}  // namespace drumgpu
@@ -0,0 +1,41 @@
+// Persistent renderer on the CPU engine, speaking the doorbell protocol in Doorbell.h.
+//
+// The CPU counterpart of the CUDA server's persistent kernel: a thread polls the ring head of a
+// mapped region and renders each job in place with a CpuModalEngine. Lets the doorbell path (and
+// anything driving it) run and be checked against the CPU engine without a GPU; drumgpu-bench's
+// doorbell cases do both.
+// Publishes its render times to the region's stats page, as a server would (see ServerStats.h).
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include "JuceGPUDrum/CpuModalEngine.h"
+#include "JuceGPUDrum/SharedLayout.h"
+
+namespace drumgpu {
+
+class CpuDoorbellRenderer {
+   public:
+    // |numThreads| as for CpuModalEngine, including the polling thread.
+    explicit CpuDoorbellRenderer(int numThreads = 1) : engine(numThreads) {}
+    ~CpuDoorbellRenderer() { stop(); }
+
+    CpuDoorbellRenderer(const CpuDoorbellRenderer&) = delete;
+    CpuDoorbellRenderer& operator=(const CpuDoorbellRenderer&) = delete;
+
+    // Start serving the region at |base|, from the job after the last one rendered.
+    void start(void* base);
+    void stop();
+
+   private:
+    void run();
+
+    CpuModalEngine engine;
+    void* region = nullptr;
+    std::atomic<bool> quit{false};
+    std::thread thread;
+};
+
+}  // namespace drumgpu
@@ -0,0 +1,69 @@
+// Lockstep rendering of independent sessions on one CPU engine pool.
+//
+// Each session (one processor, with its own kit and MIDI) has its own CpuModalEngine state, but
+// none of them owns threads. Sessions submit their block from their own thread and wait; once
+// every active session has submitted, the chunks of all their blocks are rendered in a single
+// sweep of a shared work-stealing pool. A few sessions of 10 drums leave most of a many-core
+// machine idle, while a batch of them fills it.
+//
+// For offline rendering: process() blocks on the other sessions, so it is not real-time safe.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "JuceGPUDrum/CpuModalEngine.h"
+#include "JuceGPUDrum/SharedLayout.h"
+#include "JuceGPUDrum/WorkStealingPool.h"
+
+namespace drumgpu {
+
+class CpuModalBatch {
+   public:
+    // |numThreads| includes the submitting thread that runs each sweep.
+    CpuModalBatch(int numSessions, int numThreads);
+
+    CpuModalBatch(const CpuModalBatch&) = delete;
+    CpuModalBatch& operator=(const CpuModalBatch&) = delete;
+
+    int getNumSessions() const { return static_cast<int>(sessions.size()); }
+    int getNumThreads() const { return pool.numWorkers(); }
+
+    // Render |session|'s next block from |region|, as CpuModalEngine::process(). Returns once
+    // every active session has submitted a block and all of them have been rendered.
+    void process(int session, const RegionView& region);
+
+    // |session| has no more blocks; the others no longer wait for it.
+    void finish(int session);
+
+   private:
+    struct Session {
+        std::unique_ptr<CpuModalEngine> engine;
+        RegionView region;
+        bool active = true;
+        bool submitted = false;
+    };
+
+    // Render every submitted block and release their sessions. Called with |mutex| held.
+    void renderSubmitted();
+    static void renderTask(void* batch, int task, int worker);
+
+    std::vector<Session> sessions;
+    WorkStealingPool pool;
+
+    std::mutex mutex;
+    std::condition_variable rendered;
+    int numActive = 0;
+    int numSubmitted = 0;
+    uint64_t sweep = 0;  // Sweeps rendered so far; waiting sessions watch it change.
+
+    // Submitted sessions of the current sweep, and the end of each one's range of the sweep's tasks.
+    std::vector<int> sweepSessions;
+    std::vector<int> sweepTaskEnd;
+};
+
+}  // namespace drumgpu
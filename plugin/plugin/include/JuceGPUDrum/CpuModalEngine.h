@@ -0,0 +1,106 @@
+// CPU implementation of the switched-modal filterbank.
+//
+// Implements the same math as filterbankKernel in /gpu/cuda/simple-modal-filterbank/kernel.cu,
+// plus the server's final reduction: one complex one-pole per mode driven by its bank's input
+// scaled by the mode amplitude, summed per bank (one voice of a drum) and pan-weighted into a
+// stereo block.
+// Used when no GPU server is available, and as a reference for the GPU path.
+//
+// Mode state is kept as structure-of-arrays so the recurrence runs across modes in SIMD lanes.
+// The kernel is picked at startup: AVX-512 or AVX2 where built in and supported by the CPU, else
+// SSE2 on x86 and NEON on ARM (see CpuModalKernels.h).
+//
+// With more than one thread, the modes are split into cache-sized chunks and spread over a
+// work-stealing pool. Each worker pans its chunks into its own stereo partial sums (the CPU
+// analogue of the kernel's per-warp outputs), which are reduced at the end of the block.
+//
+// Banks sleep while their input is silent and their energy has fallen below kBankSleepEnergy;
+// their chunks are skipped until the next hit.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "JuceGPUDrum/CpuModalKernels.h"
+#include "JuceGPUDrum/SharedLayout.h"
+#include "JuceGPUDrum/WorkStealingPool.h"
+
+namespace drumgpu {
+
+class CpuModalEngine {
+   public:
+    // Modes per task. 256 modes of state plus the lane accumulators fit in L1/L2.
+    static constexpr int kChunkModes = 256;
+    static_assert(kModesPerDrum % kChunkModes == 0, "chunks must not straddle banks");
+
+    // |numThreads| includes the calling (audio) thread.
+    explicit CpuModalEngine(int numThreads = 1);
+
+    // Restart the worker pool. Not real-time safe.
+    void setNumThreads(int numThreads);
+    int getNumThreads() const { return pool->numWorkers(); }
+
+    // Zero all resonator state.
+    void reset();
+
+    // Render one kBufferSize block from a region laid out as in SharedLayout.h.
+    // Each bank's input is synthesized from the |excitations| that name it (none if null).
+    // |output| receives 2 * kBufferSize interleaved stereo samples. With |updates|, only its first
+    // numBanks banks are rendered, and only the listed ranges of |modes| are reloaded; the rest
+    // keep their parameters from earlier blocks. Without, every bank is loaded and rendered.
+    void process(const ModeTable* modes, const float* drumInfo, const ExcitationList* excitations, float* output,
+                 const ModeUpdates* updates = nullptr);
+    void process(const RegionView& region) {
+        process(region.modes, region.drumInfo, region.excitations, region.output, region.updates);
+    }
+
+    // process() in three steps, for running the blocks of several engines in one sweep of a
+    // shared pool (see CpuModalBatch). beginBlock() takes the same inputs and returns the number
+    // of tasks; each is then run once with renderTask() by a worker below |numWorkers|, and
+    // endBlock() writes the output. Allocates the first time |numWorkers| grows.
+    int beginBlock(const ModeTable* modes, const float* drumInfo, const ExcitationList* excitations,
+                   const ModeUpdates* updates, int numWorkers);
+    static void renderTask(void* engine, int task, int worker);
+    void endBlock(float* output);
+
+    // Banks rendered by the last process() call; the rest were asleep.
+    int getAwakeBanks() const { return awakeBanks; }
+
+    // Name of the vector instruction set the engine runs, for logging.
+    static const char* simdName();
+
+   private:
+    // Copy modes [begin, end) out of the shared layout and regenerate their poles.
+    void loadModes(const ModeTable* modes, int begin, int end);
+
+    // Runs the mode recurrence; blocks whose input is all zero use its undriven variant, which
+    // drops the input terms.
+    const ModeKernel& kernel;
+
+    // Structure-of-arrays mode state, kNumModes entries each.
+    std::vector<float> yRe, yIm;      // Resonator state, carried across blocks.
+    std::vector<float> poleRe, poleIm;  // exp(-damp + i*freq)
+    std::vector<float> ampRe, ampIm;  // Input gain.
+    std::vector<uint8_t> enabled;     // kModeEnabled; chunks render their first to last enabled mode.
+    // Sum of |y|^2 over each chunk after it was last rendered, for putting banks to sleep.
+    std::vector<float> chunkEnergy;
+    uint8_t bankAwake[kMaxBanks] = {};
+    uint8_t bankDriven[kMaxBanks] = {};  // An excitation is playing this block.
+    // Input synthesized for the driven banks, kBufferSize per bank.
+    std::vector<float> bankInput;
+    int awakeBanks = 0;
+
+    std::unique_ptr<WorkStealingPool> pool;
+    // Per worker: kBufferSize mono scratch, and 2 * kBufferSize interleaved stereo partials.
+    std::vector<float> monoScratch;
+    std::vector<float> partials;
+    int blockWorkers = 1;  // Workers that may have written partials this block.
+
+    // Inputs of the block being rendered, for the pool tasks.
+    const ModeTable* blockModes = nullptr;
+    const float* blockDrumInfo = nullptr;
+    const ModeUpdates* blockUpdates = nullptr;
+};
+
+}  // namespace drumgpu
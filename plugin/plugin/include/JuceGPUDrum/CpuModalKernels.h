@@ -0,0 +1,43 @@
+// Vector kernels of the CPU modal engine, one per instruction set.
+//
+// The baseline kernel (SSE2 on x86-64, NEON on ARM, scalar otherwise) is built with the target's
+// default flags and always runs. On x86, AVX2 and AVX-512 kernels are built in their own
+// translation units with their ISA flags (see DRUMGPU_CPU_ENGINE_ISA in CMakeLists.txt), and
+// selectModeKernel() only picks one when the CPU and OS support it. Those units hold nothing but
+// the kernel, so no code shared with the rest of the plugin is emitted with wider instructions.
+
+#pragma once
+
+namespace drumgpu {
+
+// Structure-of-arrays mode state, as kept by CpuModalEngine.
+struct ModeKernelState {
+    float* yRe;
+    float* yIm;
+    const float* poleRe;
+    const float* poleIm;
+    const float* ampRe;
+    const float* ampIm;
+};
+
+// Run modes [begin, end) of |state| over one kBufferSize block of |input|, adding the real part
+// of each output sample into |mono|. The undriven variant ignores |input|.
+using RenderModesFn = void (*)(const ModeKernelState& state, int begin, int end, const float* input, float* mono);
+
+struct ModeKernel {
+    const char* name;
+    // Modes per vector. Ranges that are a multiple of it avoid the scalar tail.
+    int width;
+    RenderModesFn renderDriven;
+    RenderModesFn renderUndriven;
+};
+
+extern const ModeKernel kBaselineModeKernel;
+// Only defined in builds that include them.
+extern const ModeKernel kAvx2ModeKernel;
+extern const ModeKernel kAvx512ModeKernel;
+
+// The widest kernel built in that this CPU runs. Detected once.
+const ModeKernel& selectModeKernel();
+
+}  // namespace drumgpu
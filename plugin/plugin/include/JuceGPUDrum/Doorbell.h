@@ -0,0 +1,50 @@
+// Doorbell protocol for persistent renderers.
+//
+// A persistent renderer stays resident and takes jobs straight from the block ring instead of
+// waiting to be handed each one: it polls ControlBlock::head, which the plugin publishes after
+// filling a slot, renders job n from slot n % ringSlots in place (output included), and then
+// publishes ControlBlock::rendered = n + 1. Job n + 1 is not started before job n is published.
+//
+// The plugin side is unchanged: the server's host thread consumes the plugin's signal and forwards
+// each completion with forwardRenderedJob(), so nothing but that wakeup sits between the two.
+//
+// Implemented by the CUDA server's persistent kernel (DRUM_GPU_PERSISTENT=1) and, for running the
+// protocol without a GPU, by CpuDoorbellRenderer.
+
+#pragma once
+
+#include <algorithm>
+#include <thread>
+
+#include "JuceGPUDrum/ServerStats.h"
+#include "JuceGPUDrum/SharedMemoryRegion.h"
+
+namespace drumgpu {
+
+// Server host thread: wait for the plugin's next job, wait for the renderer to finish it, and
+// hand it back to the plugin. With |stats|, also records the time between the plugin's signal and
+// the hand-back, all of it spent waiting on the renderer. Pass none if the renderer publishes
+// stats itself (CpuDoorbellRenderer does): a region's stats page has one writer.
+inline void forwardRenderedJob(SharedMemoryRegion& region, ServerStatsRecorder* stats = nullptr) {
+    region.waitCPU();
+    const auto start = ServerStatsRecorder::Clock::now();
+    ControlBlock* control = region.view().control;
+    const uint32_t job = control->tail.load(std::memory_order_relaxed);
+    // The renderer usually has the job in hand already; this spins for at most one block.
+    while (control->rendered.load(std::memory_order_acquire) == job) {
+        std::this_thread::yield();
+    }
+    const double waited = ServerStatsRecorder::secondsSince(start);
+    control->tail.store(job + 1, std::memory_order_release);
+    region.signalGPU();
+    if (stats != nullptr) {
+        stats->record(kServerSync, waited);
+        stats->record(kServerTotal, waited);
+        // Banks requested; the renderer may skip those that are asleep.
+        const uint32_t numBanks = region.view(static_cast<int>(job % region.ringSlots())).updates->numBanks;
+        stats->endJob(static_cast<uint64_t>(std::min(numBanks, static_cast<uint32_t>(region.maxBanks()))) *
+                      kModesPerDrum * kBufferSize);
+    }
+}
+
+}  // namespace drumgpu
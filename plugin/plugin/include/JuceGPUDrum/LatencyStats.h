@@ -0,0 +1,98 @@
+// Timing of the audio callback, per stage, for finding where each block's time goes.
+//
+// The audio thread records durations into fixed log-spaced histograms of atomic counters: no
+// allocation and no locks. Any other thread (the editor's timer, a logger) can take a snapshot
+// at any time. A snapshot may straddle a block being recorded, so its counts can differ by one
+// between stages, but each counter is read whole.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+namespace drumgpu {
+
+class LatencyHistogram {
+   public:
+    // Bucket b holds durations up to kFirstEdgeSeconds * 2^(b / 2): half-octave steps from 10 us
+    // to about 0.5 s, with the last bucket also taking anything longer.
+    static constexpr int kNumBuckets = 32;
+    static constexpr double kFirstEdgeSeconds = 10e-6;
+
+    static double bucketEdgeSeconds(int bucket) { return kFirstEdgeSeconds * std::exp2(0.5 * bucket); }
+
+    // Audio thread only (single writer).
+    void record(double seconds) {
+        int bucket = 0;
+        if (seconds > kFirstEdgeSeconds) {
+            bucket = static_cast<int>(std::ceil(2.0 * std::log2(seconds / kFirstEdgeSeconds)));
+            bucket = bucket < kNumBuckets ? bucket : kNumBuckets - 1;
+        }
+        counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        const auto micros = static_cast<uint64_t>(seconds * 1e6);
+        totalMicros.fetch_add(micros, std::memory_order_relaxed);
+        if (micros > maxMicros.load(std::memory_order_relaxed)) {
+            maxMicros.store(micros, std::memory_order_relaxed);
+        }
+    }
+
+    struct Snapshot {
+        std::array<uint32_t, kNumBuckets> counts{};
+        uint64_t count = 0;
+        double totalSeconds = 0.0;
+        double maxSeconds = 0.0;
+
+        double meanSeconds() const { return count > 0 ? totalSeconds / static_cast<double>(count) : 0.0; }
+        // Upper edge of the bucket holding the |q| quantile (0 to 1); capped by the maximum.
+        double quantileSeconds(double q) const;
+    };
+    Snapshot snapshot() const;
+
+    // Not concurrently with record().
+    void reset();
+
+   private:
+    std::array<std::atomic<uint32_t>, kNumBuckets> counts{};
+    std::atomic<uint64_t> totalMicros{0};
+    std::atomic<uint64_t> maxMicros{0};
+};
+
+// The stages of processBlock, and blocks that overran their real-time duration.
+class LatencyStats {
+   public:
+    enum Stage {
+        kBlockTotal,  // All of processBlock.
+        kModeSetup,  // Voice, mode and excitation setup for the engine's quanta.
+        kEngineWait,  // Rendering on the CPU engine, or waiting for the GPU server's semaphore.
+        kPostFx,  // Bus compression, limiting and reverb.
+        kNumStages
+    };
+    static constexpr const char* kStageNames[kNumStages] = {"total", "modeSetup", "engineWait", "postFx"};
+
+    // Audio thread only. |blockSeconds| is the real-time duration of the block, its deadline.
+    void recordBlock(const std::array<double, kNumStages>& stageSeconds, double blockSeconds) {
+        for (int s = 0; s < kNumStages; s++) {
+            stages[s].record(stageSeconds[s]);
+        }
+        if (stageSeconds[kBlockTotal] > blockSeconds) {
+            deadlineMisses.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    struct Snapshot {
+        std::array<LatencyHistogram::Snapshot, kNumStages> stages;
+        uint64_t deadlineMisses = 0;
+    };
+    Snapshot snapshot() const;
+
+    // Not concurrently with recordBlock().
+    void reset();
+
+   private:
+    std::array<LatencyHistogram, kNumStages> stages;
+    std::atomic<uint64_t> deadlineMisses{0};
+};
+
+}  // namespace drumgpu
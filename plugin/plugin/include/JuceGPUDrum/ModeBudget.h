@@ -0,0 +1,52 @@
+// Level of detail for the filterbank: how many modes each bank renders.
+//
+// Mode sets are ordered by decreasing contribution (ModeFile::order), so culling a bank's last
+// modes in that order loses the least audible ones first. The budget caps the modes rendered per quantum
+// across all banks and follows the measured render time: when a quantum takes too much of its
+// real-time duration the budget shrinks at once, and once rendering has been comfortably fast for
+// a while it grows back towards the cap. Under load the drums lose detail instead of dropping out.
+
+#pragma once
+
+#include <algorithm>
+
+#include "JuceGPUDrum/SharedLayout.h"
+
+namespace drumgpu {
+
+class ModeBudget {
+   public:
+    // Banks keep at least this many modes however tight the budget.
+    static constexpr int kMinModesPerBank = 64;
+    // Per-bank counts are multiples of a GPU warp, so culled modes mostly skip whole warps.
+    static constexpr int kGranularity = 32;
+    static_assert(kModesPerDrum % kGranularity == 0, "banks must hold whole warps");
+
+    // Render time, as a fraction of the quantum's duration, above which the budget shrinks and
+    // below which (held for a while) it grows.
+    static constexpr double kHighLoad = 0.75;
+    static constexpr double kLowLoad = 0.5;
+
+    // Start at |maxModes| modes per quantum (0 for no cap beyond every mode of every bank), for
+    // quanta lasting |quantumSeconds|.
+    void prepare(int maxModes, double quantumSeconds);
+
+    // Modes each of |numBanks| banks may render this quantum.
+    int modesPerBank(int numBanks) const {
+        const int share = numBanks > 0 ? budget / numBanks / kGranularity * kGranularity : kModesPerDrum;
+        return std::clamp(share, kMinModesPerBank, kModesPerDrum);
+    }
+
+    // Account for a quantum of |numBanks| banks that took |renderSeconds| to render.
+    void update(double renderSeconds, int numBanks);
+
+    int getBudget() const { return budget; }
+
+   private:
+    int cap = kMaxBanks * kModesPerDrum;
+    int budget = kMaxBanks * kModesPerDrum;
+    double quantum = 0.0;
+    double peakLoad = 0.0;  // Decaying maximum of the recent load.
+};
+
+}  // namespace drumgpu
@@ -2,10 +2,19 @@
 
 #include <array>
 #include <complex>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
-#include "ModeLoader.h"
+#include <juce_core/juce_core.h>
 
 class ModeParams;
 
@@ -42,15 +51,102 @@ struct ModeFile {
     std::array<float, 1024> freqs;
     std::array<float, 1024> damps;
     std::vector<std::array<std::complex<float>, 1024>> lowvel_amps;
+    // Shimmer only modulates modes from here up.
+    static constexpr int kShimmerFirstMode = 500;
+
+    // Mode indices by decreasing contribution, for rendering a subset (see ModeBudget.h).
+    std::array<uint16_t, 1024> order;
+    // Mode held by each bank slot. Modes below kShimmerFirstMode fill the slots below it and the
+    // others the slots above, each in |order|, so the shimmered modes are one run of slots.
+    std::array<uint16_t, 1024> slotModes;
+    // How many of the first n modes of |order| are below kShimmerFirstMode. Rendering those n
+    // enables slots [0, lowModes[n]) and [kShimmerFirstMode, kShimmerFirstMode + n - lowModes[n]).
+    std::array<uint16_t, 1025> lowModes;
+    // Rate the per-sample freqs and damps are for.
+    float sampleRate = 44100.0f;
+
+    // Fill slotModes and lowModes from |order|.
+    void layoutSlots();
 };
 
+// Mode sets are indexed by name up front and read on first use, from the binary pack if one was
+// found and from the text files otherwise. The index and the loaded sets are shared by every
+// ModeLoader in the process, so plugin instances share one immutable copy of each set. Up to
+// kMaxResidentModeSets stay cached; beyond that the least recently used sets that nobody else
+// holds are dropped.
 class ModeLoader {
    public:
+    using ModeFilePtr = std::shared_ptr<const ModeFile>;
+    using LoadCallback = std::function<void(ModeFilePtr)>;
+    using BatchCallback = std::function<void(std::vector<ModeFilePtr>)>;
+
     ModeLoader();
+    ~ModeLoader();
+
+    // Attach to the process-wide set of modes, indexing the default search path if this is the
+    // first loader. Call before any loads.
+    void scanDefaultSet();
+
+    bool hasSet(const std::string& label) const { return library != nullptr && library->index.count(label) > 0; }
+
+    // Return a set, reading it now if it isn't resident. nullptr if there is no such set.
+    ModeFilePtr load(const std::string& label) { return library != nullptr ? library->load(label) : nullptr; }
+    // Load several sets at once, reading those that aren't resident in parallel. Results are in
+    // the order of |labels|.
+    std::vector<ModeFilePtr> load(const std::vector<std::string>& labels);
+    // load() on the background loader thread, which then calls |done|. Requests complete in order.
+    void loadAsync(const std::string& label, LoadCallback done);
+    void loadAsync(std::vector<std::string> labels, BatchCallback done);
+    // Block until every loadAsync() request made so far has completed.
+    void waitForPendingLoads();
+    // Drop pending requests and stop the loader thread. Later loadAsync() calls are ignored.
+    void stop();
+
+   private:
+    // Where a set comes from: an entry in the pack, or a text file.
+    struct Source {
+        int packEntry = -1;
+        juce::File file;
+    };
+
+    // The index and resident sets. Created by the first scanDefaultSet() in the process and freed
+    // with the last loader using it. The index is read-only once scanned.
+    struct Library {
+        void scanDefaultSet();
+        ModeFilePtr load(const std::string& label);
+
+        // Index every set in a binary pack written by util/modecoeffs2pack.py and keep it mapped.
+        // Returns false, indexing nothing, if the pack is invalid.
+        bool openPack(const juce::File& packFile);
+        void readPackEntry(int entry, ModeFile& modes) const;
+
+        std::map<std::string, Source> index;
+        std::unique_ptr<juce::MemoryMappedFile> pack;
+
+        // Most recently used first.
+        std::mutex cacheLock;
+        std::list<std::pair<std::string, ModeFilePtr>> resident;
+    };
+    static std::shared_ptr<Library> sharedLibrary();
+
+    static void loadSwitchedModalFromFile(const std::string& fname, ModeFile& modes);
+
+    // Per-set amplitude scaling and damping floor, applied to sets as read from either format.
+    // Also ranks the modes for ModeFile::order and lays out their slots.
+    static void normalizeModeFile(ModeFile& modes, const std::string& label);
 
-    void loadDefaultSet();
+    void loaderLoop();
 
-    void loadSwitchedModalFromFile(std::string fname, std::string label);
+    std::shared_ptr<Library> library;
 
-    std::map<std::string, ModeFile> mode_sets;
+    struct Request {
+        std::vector<std::string> labels;
+        BatchCallback done;
+    };
+    std::mutex queueLock;
+    std::condition_variable queueChanged;
+    std::deque<Request> queue;
+    bool loading = false;
+    bool stopping = false;
+    std::thread loaderThread;
 };
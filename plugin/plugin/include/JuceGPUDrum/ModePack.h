@@ -0,0 +1,52 @@
+// Binary pack of mode coefficient sets, written offline by /util/modecoeffs2pack.py from the
+// text files in res/modecoeffs and memory-mapped by ModeLoader at startup.
+//
+// Little-endian, in file order:
+//   ModePackHeader
+//   ModePackEntry[numSets]
+//   per set, at its entry's offset (kModePackAlign-aligned), float32 planes of modesPerSet each:
+//     freq | damp | amp real | amp imag | for each low velocity layer: amp real | amp imag
+//
+// Values are as in the text files; ModeLoader applies the same per-set scaling to both. Frequencies
+// and damping are per sample, at each entry's sample rate.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace drumgpu {
+
+constexpr char kModePackMagic[8] = {'D', 'G', 'M', 'P', 'A', 'C', 'K', '\0'};
+constexpr uint32_t kModePackVersion = 1;
+constexpr size_t kModePackAlign = 128;
+constexpr size_t kModePackLabelSize = 64;
+// Default file name, next to the modecoeffs directory it was converted from.
+constexpr const char* kModePackFileName = "modecoeffs.dgpack";
+
+struct ModePackHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t numSets;
+    uint32_t modesPerSet;
+    uint32_t reserved;
+    uint64_t fileSize;  // For spotting truncated files.
+};
+
+struct ModePackEntry {
+    char label[kModePackLabelSize];  // Null-terminated file name of the source set.
+    uint64_t offset;                 // From the start of the file.
+    uint32_t numLowVelocityLayers;
+    uint32_t sampleRate;  // Hz the set was fitted at; 0 (older packs) for kModeFileSampleRate.
+};
+
+// Mirrored by the struct formats in modecoeffs2pack.py.
+static_assert(std::is_standard_layout_v<ModePackHeader> && sizeof(ModePackHeader) == 32, "ModePackHeader ABI");
+static_assert(std::is_standard_layout_v<ModePackEntry> && sizeof(ModePackEntry) == 80, "ModePackEntry ABI");
+static_assert(offsetof(ModePackEntry, offset) == kModePackLabelSize, "ModePackEntry ABI");
+
+// Planes per set before the low velocity layers.
+constexpr int kModePackBasePlanes = 4;
+
+}  // namespace drumgpu
@@ -31,6 +31,7 @@ class AudioPluginAudioProcessorEditor : public juce::AudioProcessorEditor,
                                            "To be updated from JavaScript"};
 
     AudioPluginAudioProcessor& processorRef;
+    int timerTicks = 0;
 
     // Drum.gpu interop
     // (Note: moved away from attachments to route through a function; more easily supports N drums:
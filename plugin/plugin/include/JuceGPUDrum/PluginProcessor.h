@@ -3,12 +3,19 @@
 #include <juce_audio_processors/juce_audio_processors.h>
 #include <juce_dsp/juce_dsp.h>
 
-#if (JUCE_WINDOWS)
-#include <Windows.h>
-#endif
+#include <algorithm>
 #include <array>
-
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "JuceGPUDrum/BlockAdapter.h"
+#include "JuceGPUDrum/CpuModalBatch.h"
+#include "JuceGPUDrum/CpuModalEngine.h"
+#include "JuceGPUDrum/LatencyStats.h"
+#include "JuceGPUDrum/ModeBudget.h"
 #include "JuceGPUDrum/ModeLoader.h"
+#include "JuceGPUDrum/SharedMemoryRegion.h"
 
 namespace webview_plugin {
 
@@ -61,6 +68,17 @@ class AudioPluginAudioProcessor : public juce::AudioProcessor {
 
     std::atomic<float> outputLevelLeft;
 
+    // Per-stage processBlock timings and deadline misses, snapshotted lock-free by the editor.
+    const drumgpu::LatencyStats& getLatencyStats() const { return latencyStats; }
+    // The GPU server's own per-stage timings from its stats page, to tell a late server from a late
+    // plugin. False on the CPU engine or before the server has published any. Not real-time safe.
+    bool getServerStats(drumgpu::ServerStatsSummary& out) const {
+        return !useCpuEngine && sharedRegion.serverStats(out);
+    }
+    // One line summarizing them, for the log (plus one for the server's). Also logged in
+    // releaseResources().
+    juce::String describeLatencyStats() const;
+
     void loadDrumInSlot(std::string drumname, int i);
 
     void setDrum(int which, std::string name);
@@ -80,6 +98,23 @@ class AudioPluginAudioProcessor : public juce::AudioProcessor {
         dbgHits[idx] = 1;
     }
 
+    // Voices a drum can sound at once, each with its own bank of modes. Applied at the next block,
+    // as far as the engine's banks go; every drum keeps at least one.
+    enum class VoiceSteal { kRoundRobin, kOldest };
+    void setVoicesPerDrum(int drum, int voices) {
+        requestedVoices[drum].store(std::clamp(voices, 1, drumgpu::kMaxBanks), std::memory_order_relaxed);
+    }
+    void setVoiceSteal(VoiceSteal steal) { voiceSteal.store(steal, std::memory_order_relaxed); }
+
+    // The engine rendering the drums, for logging: the GPU server, or the CPU engine when no
+    // server is reachable or DRUM_GPU_FORCE_CPU is set.
+    juce::String getEngineDescription() const;
+
+    // Render as |session| of a batch shared with other processors, in lockstep with them, rather
+    // than on this processor's own CPU engine. Offline only (processBlock waits for the other
+    // sessions); ignored when a GPU server is in use.
+    void setEngineBatch(drumgpu::CpuModalBatch* batch, int session);
+
    private:
     struct Parameters {
         juce::AudioParameterFloat* gain{nullptr};
@@ -95,18 +130,125 @@ class AudioPluginAudioProcessor : public juce::AudioProcessor {
     juce::dsp::BallisticsFilter<float> envelopeFollower;
     juce::AudioBuffer<float> envelopeFollowerOutputBuffer;
 
-#if (JUCE_WINDOWS)
-    HANDLE hSemaphore;
-    HANDLE hSemaphoreGPU;
-    HANDLE hMapFile;
-    void* pSharedMem;
-#endif
+    // Transport to the GPU server process.
+    drumgpu::SharedMemoryRegion sharedRegion;
+
+    // Block ring state (see ControlBlock). Jobs [ringHead - ringPending, ringHead) are in flight.
+    int ringSlots = 1;
+    int lookaheadBlocks = 0;
+    uint32_t ringHead = 0;
+    uint32_t ringPending = 0;
+    // Wait for every job in flight. Not real-time safe.
+    void drainRing();
+
+    drumgpu::LatencyStats latencyStats;
+    // Stage times of the block being processed.
+    std::array<double, drumgpu::LatencyStats::kNumStages> blockStageSeconds{};
+
+    // Serves the engine's fixed-size blocks at the host's block size.
+    drumgpu::BlockAdapter blockAdapter;
+    // Render the next engine block into 2 * kBufferSize interleaved stereo samples.
+    void renderQuantum(float* output);
+    // Start an excitation for each note-on at [begin, end) of the host block, at its sample.
+    void collectMidi(const juce::MidiBuffer& midiMessages, int begin, int end);
+    // Host samples since prepareToPlay. The adapter's quanta start every BUFFERSIZE samples of it,
+    // which places each MIDI event within its quantum.
+    int64_t inputSamples = 0;
+
+    // Excitation envelopes driving the banks, sent to the engine as events (see ExcitationList).
+    // Each starts at its hit's sample and carries over into later quanta until it ends; hits
+    // overlap freely, including several per bank in one quantum. |start| is relative to the next
+    // quantum. Hits beyond kMaxExcitations are dropped until some finish.
+    std::array<drumgpu::Excitation, drumgpu::kMaxExcitations> excitations;
+    int numExcitations = 0;
+    // Excite |bank| from sample |offset| of the next quantum with the attack of its drum.
+    void startExcitation(int bank, int offset, float velocity);
+    // Modes rendered per bank, following the engine's render time. Capped by
+    // DRUM_GPU_MODE_BUDGET modes per block if set.
+    drumgpu::ModeBudget modeBudget;
+    int maxModeBudget = 0;
+
+    // Voice allocation (audio thread). A drum's voices are banks [voiceBase, voiceBase + voiceCount)
+    // of the engine; banks [0, numBanks) are in use.
+    struct Voice {
+        int drum = 0;
+        // Settings of the hit the voice is sounding.
+        float pitchshift = 1.0f;
+        float timestretch = 1.0f;
+        float pan = 0.5f;
+        uint64_t lastHit = 0;  // Hit counter value when last triggered; 0 if never.
+    };
+    std::array<Voice, drumgpu::kMaxBanks> voices;
+    std::array<int, kMaxDrums> voiceBase{};
+    std::array<int, kMaxDrums> voiceCount{};
+    std::array<int, kMaxDrums> nextVoice{};
+    std::array<int, kMaxDrums> laidOutVoices{};  // requestedVoices as of the last layout.
+    int numBanks = 0;
+    // Banks the engine can render.
+    int maxBanks = drumgpu::kNumDrums;
+    uint64_t hitCount = 0;
+    std::array<std::atomic<int>, kMaxDrums> requestedVoices;
+    std::atomic<VoiceSteal> voiceSteal{VoiceSteal::kRoundRobin};
+    // Reassign banks if the requested voice counts changed. Resets every voice when it does.
+    void layoutVoices();
+    // Pick a voice of |drum| for a new hit, capture the drum's settings into it, and return its bank.
+    int triggerVoice(int drum);
+
+    // CPU fallback when no GPU server is reachable; renders from a local slot with the
+    // shared memory layout.
+    bool useCpuEngine = false;
+    drumgpu::CpuModalEngine cpuEngine;
+    struct alignas(drumgpu::kModeAlign) CpuSlot {
+        char bytes[drumgpu::kSlotStride];
+    };
+    std::unique_ptr<CpuSlot> cpuRegion;
+    // Set for lockstep offline rendering; see setEngineBatch().
+    drumgpu::CpuModalBatch* engineBatch = nullptr;
+    int batchSession = 0;
 
     ModeLoader modefiles;
 
-    std::array<ModeFile*, 10> drum_assignments = {nullptr};
+    // Read by the audio thread; set from the mode loader thread once a drum's set has loaded.
+    std::array<std::atomic<const ModeFile*>, 10> drum_assignments = {};
+    // Keeps the assigned sets alive. Only used on the mode loader thread.
+    std::array<ModeLoader::ModeFilePtr, 10> drum_sets;
+    // Sets swapped out of drum_assignments, each with quantaRendered at the swap. The audio thread
+    // may be reading one until it finishes the quantum in progress, so a set is only released
+    // once quantaRendered has moved past that. Only used on the mode loader thread.
+    struct RetiredSet {
+        ModeLoader::ModeFilePtr modes;
+        uint64_t quantum = 0;
+    };
+    std::vector<RetiredSet> retired_sets;
+    // Bumped by the audio thread at the end of each renderQuantum(), once it is done with the
+    // sets it read from drum_assignments.
+    std::atomic<uint64_t> quantaRendered{0};
+    // Called on the mode loader thread with a newly loaded set.
+    void assignDrum(int which, ModeLoader::ModeFilePtr modes);
     ModeFile empty_assignment;
 
+    // What each drum's modes were last written from, to send only changed ranges.
+    struct SentModes {
+        const ModeFile* file = nullptr;
+        float pitchshift = 0.0f;
+        float timestretch = 0.0f;
+        bool shimmer = false;
+        float shimmer_high = 0.0f;
+        bool reset = false;
+        // Slots [0, lowModes) and [kShimmerFirstMode, kShimmerFirstMode + highModes) are enabled
+        // (see ModeFile::slotModes); the rest are culled.
+        int lowModes = 0;
+        int highModes = 0;
+        uint32_t generation = 0;
+    };
+    std::array<SentModes, drumgpu::kMaxBanks> sentModes;
+    // Set until the engine has been sent every mode once, and again when the sample rate changes.
+    bool forceModeUpload = true;
+    // Until the first block has been sent. Drums start from rest, and no hits play in it.
+    bool first_block = true;
+    // Host rate the modes were last scaled to.
+    float engineSampleRate = 44100.0f;
+
     void initObjects(juce::dsp::ProcessSpec spec);
     juce::dsp::Oscillator<float> lfos_shimmer[kMaxDrums];
 
@@ -134,7 +276,7 @@ class AudioPluginAudioProcessor : public juce::AudioProcessor {
     juce::Reverb reverb;
     juce::Reverb::Parameters reverbParams;
 
-    bool reset = false;
+    std::atomic<bool> reset = false;
 
     float fxa = 0.5f;
     float fxb = 0.5f;
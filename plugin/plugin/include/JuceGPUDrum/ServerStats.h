@@ -0,0 +1,162 @@
+// Per-stage timing of a server rendering jobs from the shared region, published to the region's
+// ServerStats page (see SharedLayout.h) for the plugin to read.
+//
+// The rendering thread records each job's stage times and then ends the job. When a window of
+// jobs is complete (about a second's worth), the recorder reduces it to mean, p50, p99 and max
+// per stage, plus throughput, and rewrites the page. Record jobs after handing their output back:
+// ending a window sorts its samples, which shouldn't delay the plugin.
+//
+// Header-only so the server can include it without linking plugin sources. Used by the CUDA
+// server and CpuDoorbellRenderer.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "JuceGPUDrum/SharedLayout.h"
+
+namespace drumgpu {
+
+// One line for a log: throughput, then mean/p50/p99/max per stage the server has.
+inline std::string describeServerStats(const ServerStatsSummary& summary) {
+    char text[192];
+    std::snprintf(text, sizeof(text),
+                  "server: %u jobs in %.2f s, %.1f blocks/s, %.3g mode-samples/s, %.1f%% busy (us mean/p50/p99/max):",
+                  summary.windowJobs, summary.windowSeconds, summary.blocksPerSecond, summary.modeSamplesPerSecond,
+                  summary.busyFraction * 100.0f);
+    std::string line = text;
+    for (int s = 0; s < kNumServerStages; s++) {
+        const ServerStageSummary& stage = summary.stages[s];
+        if (stage.maxUs <= 0.0f) {
+            continue;  // Not a stage of this server.
+        }
+        std::snprintf(text, sizeof(text), " %s %.0f/%.0f/%.0f/%.0f;", kServerStageNames[s], stage.meanUs, stage.p50Us,
+                      stage.p99Us, stage.maxUs);
+        line += text;
+    }
+    return line;
+}
+
+class ServerStatsRecorder {
+   public:
+    using Clock = std::chrono::steady_clock;
+    // A window also ends after this many jobs, which bounds its memory when rendering offline.
+    static constexpr size_t kMaxWindowJobs = 8192;
+
+    // Publishes to |page|, or only to lastSummary() if it's null.
+    explicit ServerStatsRecorder(ServerStats* page, double windowSeconds = 1.0)
+        : page(page), windowSeconds(windowSeconds) {
+        for (auto& samples : stageSamples) {
+            samples.reserve(kMaxWindowJobs);
+        }
+        windowStart = Clock::now();
+    }
+
+    static double secondsSince(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Also print describeServerStats() to stderr after every |windows| windows; 0 for never.
+    void setLogInterval(int windows) { logInterval = windows; }
+
+    void record(ServerStage stage, double seconds) {
+        auto& samples = stageSamples[stage];
+        if (samples.size() < kMaxWindowJobs) {
+            samples.push_back(static_cast<float>(seconds * 1e6));
+        }
+    }
+
+    // After the job's stages are recorded. |modeSamples| is modes x samples it rendered. Returns
+    // whether this ended a window and rewrote the page.
+    bool endJob(uint64_t modeSamples) {
+        jobs++;
+        windowJobs++;
+        windowModeSamples += modeSamples;
+        const double elapsed = secondsSince(windowStart);
+        if (elapsed < windowSeconds && windowJobs < kMaxWindowJobs) {
+            return false;
+        }
+        publish(elapsed);
+        if (logInterval > 0 && ++windowsPublished % logInterval == 0) {
+            std::fprintf(stderr, "%s\n", describeServerStats(summary).c_str());
+        }
+        return true;
+    }
+
+    const ServerStatsSummary& lastSummary() const { return summary; }
+
+   private:
+    void publish(double elapsed);
+
+    ServerStats* page;
+    double windowSeconds;
+    int logInterval = 0;
+    uint64_t windowsPublished = 0;
+
+    uint64_t jobs = 0;
+    uint32_t windowJobs = 0;
+    uint64_t windowModeSamples = 0;
+    Clock::time_point windowStart;
+    // Microseconds, per stage, for the jobs of the current window.
+    std::array<std::vector<float>, kNumServerStages> stageSamples;
+    ServerStatsSummary summary{};
+};
+
+inline void ServerStatsRecorder::publish(double elapsed) {
+    summary.jobs = jobs;
+    summary.windowJobs = windowJobs;
+    summary.windowSeconds = static_cast<float>(elapsed);
+    summary.blocksPerSecond = static_cast<float>(windowJobs / elapsed);
+    summary.modeSamplesPerSecond = static_cast<float>(static_cast<double>(windowModeSamples) / elapsed);
+    for (int s = 0; s < kNumServerStages; s++) {
+        auto& samples = stageSamples[s];
+        ServerStageSummary& stage = summary.stages[s];
+        stage = {};
+        if (samples.empty()) {
+            continue;
+        }
+        double sum = 0.0;
+        for (const float us : samples) {
+            sum += us;
+        }
+        stage.meanUs = static_cast<float>(sum / static_cast<double>(samples.size()));
+        // Nearest rank. Each selection leaves the samples above it in the upper part, so go up.
+        const auto rank = [&](double q) {
+            const auto r = static_cast<size_t>(std::ceil(q * static_cast<double>(samples.size())));
+            return samples.begin() + static_cast<std::ptrdiff_t>(std::max<size_t>(r, 1) - 1);
+        };
+        const auto p50 = rank(0.5);
+        std::nth_element(samples.begin(), p50, samples.end());
+        stage.p50Us = *p50;
+        const auto p99 = rank(0.99);
+        std::nth_element(p50, p99, samples.end());
+        stage.p99Us = *p99;
+        stage.maxUs = *std::max_element(p99, samples.end());
+        samples.clear();
+    }
+    const double busyUs = static_cast<double>(summary.stages[kServerTotal].meanUs) * windowJobs;
+    summary.busyFraction = static_cast<float>(busyUs * 1e-6 / elapsed);
+
+    if (page != nullptr) {
+        const uint32_t sequence = page->sequence.load(std::memory_order_relaxed);
+        page->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(static_cast<void*>(&page->summary), &summary, sizeof(summary));
+        page->sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    windowJobs = 0;
+    windowModeSamples = 0;
+    windowStart = Clock::now();
+}
+
+}  // namespace drumgpu
@@ -0,0 +1,259 @@
+// Layout of the shared memory region exchanged between the plugin and the modal filterbank
+// server (/gpu/cuda/simple-modal-filterbank, which includes this header). Also consumed
+// directly by the CPU engine, which renders from the same layout when no server is available.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Lets the persistent kernel map slots with the same code.
+#if defined(__CUDACC__)
+#define DRUMGPU_HOST_DEVICE __host__ __device__
+#else
+#define DRUMGPU_HOST_DEVICE
+#endif
+
+namespace drumgpu {
+
+constexpr int kBufferSize = 256;
+constexpr int kNumDrums = 10;
+constexpr int kModesPerDrum = 1024;
+// Resonator banks of kModesPerDrum modes. Each sounding voice of a drum has its own bank, so a
+// drum can ring with several hits at once (see ModeUpdates::numBanks). The per-bank sections
+// below are sized for this many; jobs use only the first numBanks.
+constexpr int kMaxBanks = 32;
+constexpr int kNumModes = kMaxBanks * kModesPerDrum;
+// Controllable params per bank; [0] is pan.
+constexpr int kDrumInfoStride = 8;
+
+// Engines put a bank to sleep (skip it) while its input is silent and the sum of |y|^2 over its
+// modes is below this. Even with every mode in phase, that keeps the skipped output below about
+// -110 dBFS.
+constexpr float kBankSleepEnergy = 1e-14f;
+
+constexpr size_t kSharedMemSizeBytes = 4 * 1024 * 1024;
+
+// Bumped on any change to the layout in this header. Servers publish it in the control block, and
+// the plugin won't attach to a server built against a different layout.
+constexpr uint32_t kLayoutVersion = 6;
+
+// ----- First Section: Input parameters, structure-of-arrays -----
+// One plane per parameter so that consecutive GPU threads (and CPU SIMD lanes) read consecutive
+// words. Planes start on 128-byte boundaries: one coalesced warp load, and at least a cache line
+// (and an AVX-512 vector) on the CPU.
+constexpr size_t kModeAlign = 128;
+
+enum ModeFlags : uint8_t {
+    kModeEnabled = 1 << 0,  // Cleared for silent modes (e.g. above Nyquist), which engines may skip.
+    kModeReset = 1 << 1,  // Zero the resonator before this block.
+    kModeAmpChanged = 1 << 2,
+    kModeFreqChanged = 1 << 3,
+};
+
+struct ModeTable {
+    alignas(kModeAlign) float freq[kNumModes];  // Radians per sample.
+    alignas(kModeAlign) float damp[kNumModes];
+    alignas(kModeAlign) float ampRe[kNumModes];
+    alignas(kModeAlign) float ampIm[kNumModes];
+    alignas(kModeAlign) uint8_t flags[kNumModes];  // ModeFlags.
+};
+
+// Both sides map this memory directly, possibly from different compilers: pin the layout.
+static_assert(sizeof(float) == 4, "mode planes are float32");
+static_assert(std::is_standard_layout_v<ModeTable>, "ModeTable must have a fixed layout");
+static_assert(kNumModes * sizeof(float) % kModeAlign == 0, "mode planes must stay aligned");
+static_assert(offsetof(ModeTable, freq) == 0, "ModeTable ABI");
+static_assert(offsetof(ModeTable, damp) == 1 * kNumModes * sizeof(float), "ModeTable ABI");
+static_assert(offsetof(ModeTable, ampRe) == 2 * kNumModes * sizeof(float), "ModeTable ABI");
+static_assert(offsetof(ModeTable, ampIm) == 3 * kNumModes * sizeof(float), "ModeTable ABI");
+static_assert(offsetof(ModeTable, flags) == 4 * kNumModes * sizeof(float), "ModeTable ABI");
+static_assert(sizeof(ModeTable) == 4 * kNumModes * sizeof(float) + kNumModes, "ModeTable ABI");
+
+// ----- Excitation events -----
+// Hits are sent as events rather than dense input buffers, and engines synthesize each bank's
+// input for the block from them. An event is listed in every block its envelope spans, with
+// |start| relative to that block: negative once it began in an earlier block.
+constexpr int kMaxExcitations = 64;
+
+enum ExcitationShape : uint32_t {
+    kExcitationRamp = 0,  // slope * (n - start) over [start, start + length), then silence.
+};
+
+struct Excitation {
+    uint32_t bank;
+    uint32_t shape;  // ExcitationShape.
+    int32_t start;  // Sample of this block the envelope starts at.
+    int32_t length;  // Samples the envelope lasts.
+    float slope;
+};
+
+struct ExcitationList {
+    uint32_t numEvents;
+    Excitation events[kMaxExcitations];
+};
+static_assert(std::is_standard_layout_v<ExcitationList> && sizeof(Excitation) == 20 &&
+                  sizeof(ExcitationList) == 4 + kMaxExcitations * sizeof(Excitation),
+              "ExcitationList ABI");
+
+// |event|'s contribution to its bank's input at sample |samp| of the block.
+DRUMGPU_HOST_DEVICE inline float excitationSample(const Excitation& event, int samp) {
+    const int n = samp - event.start;
+    if (n < 0 || n >= event.length) {
+        return 0.0f;
+    }
+    switch (event.shape) {
+        case kExcitationRamp:
+            return event.slope * static_cast<float>(n);
+        default:
+            return 0.0f;
+    }
+}
+
+// ----- Per-job mode updates -----
+// Modes are only rewritten when their parameters change. Each job lists the ranges of its
+// ModeTable that were written for it; entries outside them may be stale, and servers keep
+// their own copy of the table that they patch with these ranges in job order.
+constexpr int kMaxModeRanges = 2 * kMaxBanks;
+
+struct ModeRange {
+    uint32_t first;
+    uint32_t count;
+};
+
+struct ModeUpdates {
+    uint32_t numRanges;
+    // Banks rendered for this job, at most the server's ControlBlock::maxBanks.
+    uint32_t numBanks;
+    // Bumped by the plugin each time any of a bank's modes are rewritten.
+    uint32_t bankGeneration[kMaxBanks];
+    ModeRange ranges[kMaxModeRanges];
+};
+
+// ----- Last page: control block -----
+// Written by the server when it creates the region. The sequence counters carry the block
+// handshake on platforms that signal through the region itself (futexes on Linux).
+constexpr uint32_t kControlMagic = 0x44474755;  // "DGGU"
+constexpr size_t kControlBlockOffset = kSharedMemSizeBytes - 4096;
+
+struct ControlBlock {
+    uint32_t magic;
+    uint32_t serverPid;
+    std::atomic<uint32_t> cpuSeq;  // Bumped by the plugin when a block of input is ready.
+    std::atomic<uint32_t> gpuSeq;  // Bumped by the server when the block's output is ready.
+
+    // Block ring. Job n uses slot n % ringSlots; the plugin publishes head after filling a
+    // slot, the server publishes tail after writing its output. ringSlots is advertised by the
+    // server (0 runs lock-step on slot 0).
+    uint32_t ringSlots;
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+
+    uint32_t layoutVersion;  // kLayoutVersion of the server.
+
+    // Jobs completed by a persistent renderer polling head (see Doorbell.h).
+    std::atomic<uint32_t> rendered;
+
+    // Banks the server can render per job, up to kMaxBanks.
+    uint32_t maxBanks;
+};
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "control block atomics must be address-free");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "control block atomics must be plain words");
+static_assert(offsetof(ControlBlock, ringSlots) == 16 && offsetof(ControlBlock, layoutVersion) == 28 &&
+                  offsetof(ControlBlock, rendered) == 32 && offsetof(ControlBlock, maxBanks) == 36 &&
+                  sizeof(ControlBlock) == 40,
+              "ControlBlock ABI");
+
+// ----- Page before the control block: server stats -----
+// Timing of the server's recent jobs, so a late block can be put down to the plugin or the server.
+// The server rewrites the summary about once a second under a sequence lock: sequence is odd
+// while a rewrite is in progress. Readers copy the summary and keep it only if sequence was even
+// and unchanged throughout (SharedMemoryRegion::serverStats). Written by ServerStatsRecorder.
+constexpr size_t kServerStatsOffset = kControlBlockOffset - 4096;
+
+// Stages of a server job. Not every server has every stage; missing ones read as zero.
+enum ServerStage {
+    kServerUpload,  // Mode, drum info and event copies to the device.
+    kServerKernel,  // The filterbank kernel, or the CPU engine's render.
+    kServerSync,  // Host time blocked on the device finishing the job.
+    kServerDownload,  // Output and bank energy copies back.
+    kServerReduce,  // Summing per-warp partials into the output block.
+    kServerTotal,  // From the plugin's signal to the output being handed back.
+    kNumServerStages
+};
+inline constexpr const char* kServerStageNames[kNumServerStages] = {"upload", "kernel", "sync",
+                                                                    "download", "reduce", "total"};
+
+struct ServerStageSummary {
+    float meanUs;
+    float p50Us;
+    float p99Us;
+    float maxUs;
+};
+
+struct ServerStatsSummary {
+    uint64_t jobs;  // Rendered since the server started.
+    uint32_t windowJobs;  // Jobs in the window the fields below describe.
+    float windowSeconds;  // Wall time of the window.
+    float blocksPerSecond;
+    float modeSamplesPerSecond;  // Awake modes x samples rendered, per wall second.
+    float busyFraction;  // Share of the window spent in jobs (total stage time / wall time).
+    uint32_t reserved;
+    ServerStageSummary stages[kNumServerStages];
+};
+
+struct ServerStats {
+    std::atomic<uint32_t> sequence;
+    uint32_t reserved;
+    ServerStatsSummary summary;
+};
+static_assert(std::is_trivially_copyable_v<ServerStatsSummary>, "ServerStatsSummary is copied through the region");
+static_assert(offsetof(ServerStatsSummary, windowJobs) == 8 && offsetof(ServerStatsSummary, stages) == 32 &&
+                  sizeof(ServerStageSummary) == 16 && sizeof(ServerStatsSummary) == 32 + 16 * kNumServerStages,
+              "ServerStatsSummary ABI");
+static_assert(offsetof(ServerStats, summary) == 8 && sizeof(ServerStats) <= 4096, "ServerStats ABI");
+
+// ----- Block slots -----
+// Each slot holds one complete block job with the sections below; slot 0 is at the start of
+// the region, so a lock-step server sees the original single-block layout.
+constexpr size_t kSlotStride = 1024 * 1024;
+constexpr int kRingSlots = 3;
+
+// Pointers into each section of a slot in a mapped region:
+// ModeTable | drum info[kMaxBanks * kDrumInfoStride] | ExcitationList | output[2 * kBufferSize] | ModeUpdates
+// ... | ServerStats at kServerStatsOffset | ControlBlock at kControlBlockOffset from the start of the region
+struct RegionView {
+    ModeTable* modes = nullptr;
+    float* drumInfo = nullptr;
+    ExcitationList* excitations = nullptr;
+    float* output = nullptr;  // Interleaved stereo.
+    ModeUpdates* updates = nullptr;
+    ServerStats* stats = nullptr;
+    ControlBlock* control = nullptr;
+
+    DRUMGPU_HOST_DEVICE static RegionView map(void* base, int slot = 0) {
+        RegionView v;
+        char* p = static_cast<char*>(base) + slot * kSlotStride;
+        v.modes = reinterpret_cast<ModeTable*>(p);
+        p += sizeof(ModeTable);
+        v.drumInfo = reinterpret_cast<float*>(p);
+        p += kMaxBanks * kDrumInfoStride * sizeof(float);
+        v.excitations = reinterpret_cast<ExcitationList*>(p);
+        p += sizeof(ExcitationList);
+        v.output = reinterpret_cast<float*>(p);
+        p += 2 * kBufferSize * sizeof(float);
+        v.updates = reinterpret_cast<ModeUpdates*>(p);
+        v.stats = reinterpret_cast<ServerStats*>(static_cast<char*>(base) + kServerStatsOffset);
+        v.control = reinterpret_cast<ControlBlock*>(static_cast<char*>(base) + kControlBlockOffset);
+        return v;
+    }
+};
+
+static_assert(sizeof(ModeTable) + (kMaxBanks * kDrumInfoStride + 2 * kBufferSize) * sizeof(float) + sizeof(ExcitationList) +
+                      sizeof(ModeUpdates) <= kSlotStride,
+              "block job exceeds kSlotStride");
+static_assert(kRingSlots * kSlotStride <= kServerStatsOffset, "block slots overlap the server stats page");
+
+}  // namespace drumgpu
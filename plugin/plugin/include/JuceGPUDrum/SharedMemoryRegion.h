@@ -0,0 +1,409 @@
+// Defines a region of mapped shared memory between the plugin and a GPU server process.
+// Also includes the signals used to hand work across: the plugin signals "CPU" when a block of
+// input is ready, and the server signals "GPU" when its output is ready.
+//
+// Per platform:
+//  - Windows: named file mapping and named semaphores.
+//  - macOS: POSIX shm_open/mmap and named POSIX semaphores.
+//  - Linux: POSIX shm_open/mmap, with futexes on the sequence counters in the region's
+//    ControlBlock (see SharedLayout.h); no kernel objects besides the mapping itself.
+//
+// The server creates the region and signals with create(); the plugin attaches with open() and
+// must not rely on the region if that fails. Names and size are magic constants shared with
+// /gpu/cuda/simple-modal-filterbank and /gpu/metal/simple-modal.
+//
+// Header-only so the server can include it without linking plugin sources.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+
+#include "JuceGPUDrum/SharedLayout.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <climits>
+#include <csignal>
+#include <cerrno>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+namespace drumgpu {
+
+class SharedMemoryRegion {
+   public:
+#if defined(_WIN32)
+    static constexpr const char* kSharedMemName = "Local\\GPUModalBankMem";
+    static constexpr const char* kSemCPUName = "Local\\GPUModalBankSemaphore";
+    static constexpr const char* kSemGPUName = "Local\\GPUModalBankSemaphoreGPU";
+#else
+    static constexpr const char* kSharedMemName = "/drumgpu_shared_memory";
+    static constexpr const char* kSemCPUName = "/sem_modalfilterbank_cpu";
+    static constexpr const char* kSemGPUName = "/sem_modalfilterbank_gpu";
+#endif
+
+    SharedMemoryRegion() {}
+    ~SharedMemoryRegion() {
+        cleanup();
+    }
+    SharedMemoryRegion(const SharedMemoryRegion&) = delete;
+    SharedMemoryRegion& operator=(const SharedMemoryRegion&) = delete;
+
+    // Plugin side: attach to a region created by a running server.
+    bool open();
+    // Server side: create (or recreate) the region and its signals.
+    bool create();
+    void cleanup();
+
+    bool ready() const { return is_ready; }
+    void* getAddr() const { return memory; }
+    size_t getSizeBytes() const { return is_ready ? kSharedMemSizeBytes : 0; }
+    RegionView view(int slot = 0) const { return RegionView::map(memory, slot); }
+
+    // Slots in the block ring as advertised by the server; 1 for a lock-step server.
+    int ringSlots() const {
+        const auto* control = view().control;
+        if (!is_ready || control->magic != kControlMagic || control->ringSlots == 0) {
+            return 1;
+        }
+        return control->ringSlots < static_cast<uint32_t>(kRingSlots) ? static_cast<int>(control->ringSlots) : kRingSlots;
+    }
+
+    // Banks the server can render per job, as advertised by the server.
+    int maxBanks() const {
+        const auto* control = view().control;
+        if (!is_ready || control->magic != kControlMagic) {
+            return kNumDrums;
+        }
+        return static_cast<int>(control->maxBanks < static_cast<uint32_t>(kMaxBanks) ? control->maxBanks : kMaxBanks);
+    }
+
+    // The server's latest published timing summary (see ServerStats). False if there is no server
+    // or nothing published yet, or if the server kept rewriting it while it was being copied.
+    // Not real-time safe: for a UI timer or a logger.
+    bool serverStats(ServerStatsSummary& out) const {
+        if (!is_ready) {
+            return false;
+        }
+        const ServerStats* stats = view().stats;
+        for (int attempt = 0; attempt < 4; attempt++) {
+            const uint32_t before = stats->sequence.load(std::memory_order_acquire);
+            if (before & 1) {
+                continue;
+            }
+            std::memcpy(&out, &stats->summary, sizeof(out));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (stats->sequence.load(std::memory_order_relaxed) == before) {
+                return out.jobs > 0;
+            }
+        }
+        return false;
+    }
+
+    // Plugin -> server: input is ready.
+    void signalCPU();
+    void waitCPU();
+    // Server -> plugin: output is ready.
+    void signalGPU();
+    void waitGPU();
+
+   private:
+    // Whether the mapped region was created by a server using this layout.
+    bool compatibleServer() const {
+        const auto* control = view().control;
+        return control->magic == kControlMagic && control->layoutVersion == kLayoutVersion;
+    }
+
+    // Whether both shared memory and the signals are initialized.
+    // Shouldn't need atomic<bool>: should be monotonic and only written during initialization.
+    bool is_ready = false;
+    bool is_owner = false;
+
+    // Shared memory
+    void* memory = nullptr;
+
+#if defined(_WIN32)
+    HANDLE hMapFile = nullptr;
+    HANDLE semCPU = nullptr;
+    HANDLE semGPU = nullptr;
+#elif defined(__linux__)
+    // Sequence numbers this side has consumed.
+    uint32_t cpuSeen = 0;
+    uint32_t gpuSeen = 0;
+
+    static void futexWait(std::atomic<uint32_t>& word, uint32_t expected) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, nullptr, nullptr, 0);
+    }
+    static void futexWake(std::atomic<uint32_t>& word) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+    static void post(std::atomic<uint32_t>& seq) {
+        seq.fetch_add(1, std::memory_order_release);
+        futexWake(seq);
+    }
+    static void wait(std::atomic<uint32_t>& seq, uint32_t& seen) {
+        uint32_t current;
+        while ((current = seq.load(std::memory_order_acquire)) == seen) {
+            futexWait(seq, current);
+        }
+        seen++;
+    }
+#else
+    sem_t* semCPU = nullptr;
+    sem_t* semGPU = nullptr;
+#endif
+};
+
+#if defined(_WIN32)
+
+inline bool SharedMemoryRegion::open() {
+    cleanup();
+    hMapFile = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, kSharedMemName);
+    if (hMapFile == nullptr) {
+        return false;
+    }
+    memory = MapViewOfFile(hMapFile, FILE_MAP_ALL_ACCESS, 0, 0, kSharedMemSizeBytes);
+    semCPU = OpenSemaphoreA(SEMAPHORE_ALL_ACCESS, FALSE, kSemCPUName);
+    semGPU = OpenSemaphoreA(SEMAPHORE_ALL_ACCESS, FALSE, kSemGPUName);
+    if (memory == nullptr || semCPU == nullptr || semGPU == nullptr || !compatibleServer()) {
+        cleanup();
+        return false;
+    }
+    is_ready = true;
+    return true;
+}
+
+inline bool SharedMemoryRegion::create() {
+    cleanup();
+    hMapFile = CreateFileMappingA(INVALID_HANDLE_VALUE,  // use paging file
+                                  NULL,                  // default security
+                                  PAGE_READWRITE,
+                                  0,                     // max object size (high-order)
+                                  static_cast<DWORD>(kSharedMemSizeBytes),
+                                  kSharedMemName);
+    if (hMapFile == nullptr) {
+        return false;
+    }
+    memory = MapViewOfFile(hMapFile, FILE_MAP_ALL_ACCESS, 0, 0, kSharedMemSizeBytes);
+    // One count per job in flight.
+    semCPU = CreateSemaphoreA(NULL, 0, kRingSlots, kSemCPUName);
+    semGPU = CreateSemaphoreA(NULL, 0, kRingSlots, kSemGPUName);
+    if (memory == nullptr || semCPU == nullptr || semGPU == nullptr) {
+        cleanup();
+        return false;
+    }
+    auto* control = view().control;
+    control->ringSlots = kRingSlots;
+    control->maxBanks = kMaxBanks;
+    control->layoutVersion = kLayoutVersion;
+    control->head.store(0, std::memory_order_relaxed);
+    control->tail.store(0, std::memory_order_relaxed);
+    control->rendered.store(0, std::memory_order_relaxed);
+    std::memset(static_cast<void*>(view().stats), 0, sizeof(ServerStats));
+    control->magic = kControlMagic;
+    control->serverPid = GetCurrentProcessId();
+    is_owner = true;
+    is_ready = true;
+    return true;
+}
+
+inline void SharedMemoryRegion::cleanup() {
+    is_ready = false;
+    is_owner = false;
+    if (memory) {
+        UnmapViewOfFile(memory);
+        memory = nullptr;
+    }
+    for (HANDLE* h : {&hMapFile, &semCPU, &semGPU}) {
+        if (*h) {
+            CloseHandle(*h);
+            *h = nullptr;
+        }
+    }
+}
+
+inline void SharedMemoryRegion::signalCPU() {
+    ReleaseSemaphore(semCPU, 1, NULL);
+}
+inline void SharedMemoryRegion::waitCPU() {
+    WaitForSingleObject(semCPU, INFINITE);
+}
+inline void SharedMemoryRegion::signalGPU() {
+    ReleaseSemaphore(semGPU, 1, NULL);
+}
+inline void SharedMemoryRegion::waitGPU() {
+    WaitForSingleObject(semGPU, INFINITE);
+}
+
+#else  // POSIX
+
+inline bool SharedMemoryRegion::open() {
+    cleanup();
+    int fd = shm_open(kSharedMemName, O_RDWR, 0666);
+    if (fd == -1) {
+        // CLEANUP: Consider creating the region here.
+        // This would let us start the plugin first.
+        // This is a simple technical change but it's likely documented as being owned by the server process in multiple places
+        return false;
+    }
+
+    memory = mmap(NULL, kSharedMemSizeBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        memory = nullptr;
+        return false;
+    }
+
+#if defined(__linux__)
+    // A server killed without cleanup leaves its region behind; make sure someone is home.
+    auto* control = view().control;
+    if (!compatibleServer() || control->serverPid == 0 ||
+        (kill(static_cast<pid_t>(control->serverPid), 0) != 0 && errno != EPERM)) {
+        cleanup();
+        return false;
+    }
+    cpuSeen = control->cpuSeq.load(std::memory_order_acquire);
+    gpuSeen = control->gpuSeq.load(std::memory_order_acquire);
+#else
+    // We also need the semaphores.
+    semCPU = sem_open(kSemCPUName, O_RDWR, 0666, 0);
+    semGPU = sem_open(kSemGPUName, O_RDWR, 0666, 0);
+    if (semCPU == SEM_FAILED || semGPU == SEM_FAILED || !compatibleServer()) {
+        cleanup();
+        return false;
+    }
+#endif
+
+    // Success
+    is_ready = true;
+    return true;
+}
+
+inline bool SharedMemoryRegion::create() {
+    cleanup();
+    int fd = shm_open(kSharedMemName, O_RDWR | O_CREAT, 0666);
+    if (fd == -1) {
+        return false;
+    }
+    if (ftruncate(fd, kSharedMemSizeBytes) == -1) {
+        // macOS only allows sizing a new object; an existing one of the right size is fine.
+        struct stat st;
+        if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < kSharedMemSizeBytes) {
+            close(fd);
+            return false;
+        }
+    }
+    memory = mmap(NULL, kSharedMemSizeBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        memory = nullptr;
+        return false;
+    }
+    is_owner = true;
+
+    auto* control = view().control;
+#if defined(__linux__)
+    control->cpuSeq.store(0, std::memory_order_relaxed);
+    control->gpuSeq.store(0, std::memory_order_relaxed);
+    cpuSeen = 0;
+    gpuSeen = 0;
+#else
+    sem_unlink(kSemCPUName);
+    sem_unlink(kSemGPUName);
+    semCPU = sem_open(kSemCPUName, O_CREAT, 0666, 0);
+    semGPU = sem_open(kSemGPUName, O_CREAT, 0666, 0);
+    if (semCPU == SEM_FAILED || semGPU == SEM_FAILED) {
+        cleanup();
+        return false;
+    }
+#endif
+    control->ringSlots = kRingSlots;
+    control->maxBanks = kMaxBanks;
+    control->layoutVersion = kLayoutVersion;
+    control->head.store(0, std::memory_order_relaxed);
+    control->tail.store(0, std::memory_order_relaxed);
+    control->rendered.store(0, std::memory_order_relaxed);
+    std::memset(static_cast<void*>(view().stats), 0, sizeof(ServerStats));
+    control->serverPid = static_cast<uint32_t>(getpid());
+    control->magic = kControlMagic;
+
+    is_ready = true;
+    return true;
+}
+
+inline void SharedMemoryRegion::cleanup() {
+    if (memory && is_owner) {
+        view().control->magic = 0;
+        shm_unlink(kSharedMemName);
+    }
+    is_ready = false;
+
+    if (memory) {
+        munmap(memory, kSharedMemSizeBytes);
+        memory = nullptr;
+    }
+
+#if !defined(__linux__)
+    if (semCPU && semCPU != SEM_FAILED) {
+        sem_close(semCPU);
+    }
+    semCPU = nullptr;
+    if (semGPU && semGPU != SEM_FAILED) {
+        sem_close(semGPU);
+    }
+    semGPU = nullptr;
+    if (is_owner) {
+        sem_unlink(kSemCPUName);
+        sem_unlink(kSemGPUName);
+    }
+#endif
+    is_owner = false;
+}
+
+#if defined(__linux__)
+inline void SharedMemoryRegion::signalCPU() {
+    post(view().control->cpuSeq);
+}
+inline void SharedMemoryRegion::waitCPU() {
+    wait(view().control->cpuSeq, cpuSeen);
+}
+inline void SharedMemoryRegion::signalGPU() {
+    post(view().control->gpuSeq);
+}
+inline void SharedMemoryRegion::waitGPU() {
+    wait(view().control->gpuSeq, gpuSeen);
+}
+#else
+inline void SharedMemoryRegion::signalCPU() {
+    sem_post(semCPU);
+}
+inline void SharedMemoryRegion::waitCPU() {
+    sem_wait(semCPU);
+}
+inline void SharedMemoryRegion::signalGPU() {
+    sem_post(semGPU);
+}
+inline void SharedMemoryRegion::waitGPU() {
+    sem_wait(semGPU);
+}
+#endif
+
+#endif  // _WIN32
+
+}  // namespace drumgpu
@@ -0,0 +1,66 @@
+// Fork/join thread pool for per-block work on the audio thread.
+//
+// run() hands each worker a contiguous share of the task indices; a worker that drains its own
+// share steals from the back of the others'. The calling thread takes part as worker 0, so a
+// pool of N workers owns N - 1 threads. Workers sleep between blocks and can be pinned to cores.
+//
+// run() returns once every task has finished, not once every worker has woken: the caller steals
+// whatever the others haven't started, so it only waits for tasks already running elsewhere. A
+// worker that wakes late finds nothing left and goes back to sleep.
+//
+// run() does not allocate or lock, so it is safe to call from the audio callback. Construction
+// and destruction start and join threads and are not.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace drumgpu {
+
+class WorkStealingPool {
+   public:
+    // Called once per task with the index of the worker running it.
+    using TaskFn = void (*)(void* context, int task, int worker);
+
+    // Pinning worker i to core i keeps its caches warm, but a pinned worker can't move away from
+    // a busy core (such as a real-time audio thread's), so it is off by default.
+    explicit WorkStealingPool(int numWorkers, bool pinThreads = false);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    int numWorkers() const { return static_cast<int>(workers.size()); }
+
+    // Run fn for every task in [0, numTasks) and return once all have finished.
+    void run(int numTasks, TaskFn fn, void* context);
+
+   private:
+    struct alignas(64) Worker {
+        // Remaining tasks [begin, end), packed as begin << 32 | end. The owner takes from the
+        // front and thieves from the back, both with a CAS on the whole range.
+        std::atomic<uint64_t> range{0};
+        std::thread thread;
+    };
+
+    void threadLoop(int worker, bool pin);
+    void work(int worker);
+    int popFront(int worker);
+    int steal(int thief);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    TaskFn taskFn = nullptr;
+    void* taskContext = nullptr;
+
+    std::atomic<uint32_t> generation{0};
+    // Tasks of the current run() not yet finished.
+    std::atomic<int> pendingTasks{0};
+    std::atomic<bool> quit{false};
+};
+
+}  // namespace drumgpu
@@ -11,15 +11,34 @@ constexpr bool kWebUIUseDevServer = false;
 
 // Internal/Debug constants
 constexpr int kCymIDOffset = 6;
-constexpr bool kLogBufferProcessingTimes = false;
 
 // Whether to force mono for live demos with a floor monitor.
 constexpr bool kForceMono = true;
 
 
 // Constants
-// CLEANUP: hardcoded sample rate.
-constexpr float kSampleRate = 44100.0f;
-constexpr float _hz2rad = 2.0f * 3.141529f / kSampleRate;
+// Rate the text mode files were fitted at. Each loaded set records its rate (see ModeFile), and
+// its frequencies and damping are rescaled to the host's rate when they are sent to the engine.
+constexpr float kModeFileSampleRate = 44100.0f;
+constexpr float _hz2rad = 2.0f * 3.141529f / kModeFileSampleRate;
 
-constexpr bool kLogLoadedFiles = false;
\ No newline at end of file
+constexpr bool kLogLoadedFiles = false;
+
+// Upper bound on CPU engine threads (including the audio thread) when no GPU server is running.
+// Defaults to half the cores up to this; override with the environment variable DRUM_GPU_CPU_THREADS.
+constexpr int kCpuEngineMaxThreads = 8;
+
+// Blocks the GPU server may render ahead of the host, bounded by its ring size. Adds this many
+// blocks of reported latency in exchange for tolerance to GPU scheduling jitter.
+// Override with the environment variable DRUM_GPU_LOOKAHEAD_BLOCKS; 0 is lock-step.
+constexpr int kDefaultLookaheadBlocks = 1;
+
+// Voices each drum can sound at once, for overlapping hits (rolls, flams) with their own pitch
+// and pan. Each costs a bank of modes; override with the environment variable
+// DRUM_GPU_VOICES_PER_DRUM, and choose what a new hit takes over with DRUM_GPU_VOICE_STEAL
+// ("roundrobin", the default, or "oldest").
+constexpr int kDefaultVoicesPerDrum = 1;
+
+// Mode sets kept in memory once loaded, least recently used dropped first. Sets assigned to drums
+// are always kept, even past this.
+constexpr int kMaxResidentModeSets = 16;
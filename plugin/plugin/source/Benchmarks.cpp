@@ -0,0 +1,311 @@
+// Benchmarks for the modal engine, mode loading and processBlock, on Google Benchmark.
+//
+// Configure with -DDRUMGPU_BUILD_BENCHMARKS=ON and run drumgpu-bench. Add
+// --benchmark_out=results.json --benchmark_out_format=json to keep the results for comparison
+// across releases (e.g. with Google Benchmark's tools/compare.py).
+//
+// Mode loading and processBlock read the sets in DRUM_GPU_RESOURCES_DIR, or in the repository's
+// res directory if it isn't set. The binary cases need the pack written by
+// util/modecoeffs2pack.py and are skipped without it. processBlock renders on the CPU engine,
+// which stands in for the GPU server's transport, and the doorbell cases serve the persistent
+// kernel's protocol with CpuDoorbellRenderer.
+
+#include <benchmark/benchmark.h>
+#include <juce_events/juce_events.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "JuceGPUDrum/CpuDoorbellRenderer.h"
+#include "JuceGPUDrum/CpuModalEngine.h"
+#include "JuceGPUDrum/ModeLoader.h"
+#include "JuceGPUDrum/ModePack.h"
+#include "JuceGPUDrum/PluginProcessor.h"
+#include "JuceGPUDrum/SharedLayout.h"
+
+namespace {
+
+using drumgpu::kBufferSize;
+using drumgpu::kModesPerDrum;
+
+constexpr double kSampleRate = 48000.0;
+
+void setEnv(const char* name, const char* value) {
+#if defined(_WIN32)
+    _putenv_s(name, value);
+#else
+    setenv(name, value, 1);
+#endif
+}
+
+// ----- Mode recurrence -----
+
+struct alignas(drumgpu::kModeAlign) EngineSlot {
+    char bytes[drumgpu::kSlotStride];
+};
+
+// Random decaying modes across |numBanks| banks, all enabled and listed as updated.
+void fillModes(const drumgpu::RegionView& region, int numBanks) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const int numModes = numBanks * kModesPerDrum;
+    for (int i = 0; i < numModes; i++) {
+        region.modes->freq[i] = unit(rng) * 3.0f;
+        region.modes->damp[i] = 1e-4f + unit(rng) * 1e-3f;
+        region.modes->ampRe[i] = unit(rng) * 1e-3f;
+        region.modes->ampIm[i] = 0.0f;
+        region.modes->flags[i] = drumgpu::kModeEnabled;
+    }
+    for (int b = 0; b < numBanks; b++) {
+        region.drumInfo[b * drumgpu::kDrumInfoStride] = 0.5f;
+    }
+    region.updates->numBanks = static_cast<uint32_t>(numBanks);
+    region.updates->numRanges = 1;
+    region.updates->ranges[0] = {0, static_cast<uint32_t>(numModes)};
+}
+
+// Hit every bank at the start of the block.
+void exciteBanks(const drumgpu::RegionView& region, int numBanks) {
+    region.excitations->numEvents = static_cast<uint32_t>(numBanks);
+    for (int b = 0; b < numBanks; b++) {
+        region.excitations->events[b] = {static_cast<uint32_t>(b), drumgpu::kExcitationRamp, 0, kBufferSize, 1e-4f};
+    }
+}
+
+// CpuModalEngine blocks (SIMD across modes). Args: banks, threads, driven. Undriven blocks are
+// rung out: their banks are only hit every 64th block, which keeps them awake. The label names
+// the vector ISA; configure with -DDRUMGPU_CPU_ENGINE_ISA=NONE to measure the baseline SSE2 kernel.
+void BM_EngineBlock(benchmark::State& state) {
+    const int numBanks = static_cast<int>(state.range(0));
+    const bool driven = state.range(2) != 0;
+    drumgpu::CpuModalEngine engine(static_cast<int>(state.range(1)));
+    auto slot = std::make_unique<EngineSlot>();
+    const drumgpu::RegionView region = drumgpu::RegionView::map(slot->bytes);
+    fillModes(region, numBanks);
+    exciteBanks(region, numBanks);
+    engine.process(region);
+    region.updates->numRanges = 0;
+
+    int64_t block = 0;
+    for (auto _ : state) {
+        if (driven || ++block % 64 == 0) {
+            exciteBanks(region, numBanks);
+        } else {
+            region.excitations->numEvents = 0;
+        }
+        engine.process(region);
+        benchmark::DoNotOptimize(region.output[0]);
+    }
+    state.SetItemsProcessed(state.iterations() * numBanks * kModesPerDrum * kBufferSize);
+    state.SetLabel(drumgpu::CpuModalEngine::simdName());
+}
+BENCHMARK(BM_EngineBlock)
+    ->ArgNames({"banks", "threads", "driven"})
+    ->ArgsProduct({{1, 10, 32}, {1, 4}, {0, 1}})
+    ->UseRealTime();
+
+// ----- Doorbell -----
+
+struct alignas(drumgpu::kModeAlign) DoorbellRegion {
+    char bytes[drumgpu::kSharedMemSizeBytes];
+};
+
+// Fill job |job|'s slot of the ring at |base|, hitting every bank every 8th job; the first job
+// lists every mode as updated. Also render it on |reference|, for comparing outputs.
+void queueDoorbellJob(char* base, uint32_t job, int numBanks, drumgpu::CpuModalEngine* reference,
+                      const drumgpu::RegionView& referenceSlot) {
+    const drumgpu::RegionView slot = drumgpu::RegionView::map(base, static_cast<int>(job % drumgpu::kRingSlots));
+    const auto queue = [&](const drumgpu::RegionView& region) {
+        region.updates->numRanges = job == 0 ? 1 : 0;
+        if (job % 8 == 0) {
+            exciteBanks(region, numBanks);
+        } else {
+            region.excitations->numEvents = 0;
+        }
+    };
+    queue(slot);
+    if (reference != nullptr) {
+        queue(referenceSlot);
+        reference->process(referenceSlot);
+    }
+}
+
+// Jobs through CpuDoorbellRenderer, the CPU stand-in for the persistent kernel: ring the doorbell
+// of a block ring and wait for the job to be published. Before timing, checks that the first
+// jobs' outputs match CpuModalEngine::process on the same modes and hits. Arg: banks.
+void BM_DoorbellJob(benchmark::State& state) {
+    const int numBanks = static_cast<int>(state.range(0));
+    auto region = std::make_unique<DoorbellRegion>();
+    for (int s = 0; s < drumgpu::kRingSlots; s++) {
+        fillModes(drumgpu::RegionView::map(region->bytes, s), numBanks);
+    }
+    drumgpu::ControlBlock* control = drumgpu::RegionView::map(region->bytes).control;
+    control->ringSlots = drumgpu::kRingSlots;
+
+    drumgpu::CpuModalEngine reference;
+    auto referenceSlot = std::make_unique<EngineSlot>();
+    const drumgpu::RegionView referenceRegion = drumgpu::RegionView::map(referenceSlot->bytes);
+    fillModes(referenceRegion, numBanks);
+
+    drumgpu::CpuDoorbellRenderer renderer;
+    renderer.start(region->bytes);
+    const auto ringJob = [&](uint32_t job) {
+        control->head.store(job + 1, std::memory_order_release);
+        // As forwardRenderedJob() waits on the server's host thread.
+        while (control->rendered.load(std::memory_order_acquire) == job) {
+            std::this_thread::yield();
+        }
+    };
+
+    uint32_t job = 0;
+    for (; job < 64; job++) {
+        queueDoorbellJob(region->bytes, job, numBanks, &reference, referenceRegion);
+        ringJob(job);
+        const float* output = drumgpu::RegionView::map(region->bytes, static_cast<int>(job % drumgpu::kRingSlots)).output;
+        if (!std::equal(output, output + 2 * kBufferSize, referenceRegion.output)) {
+            renderer.stop();
+            state.SkipWithError("doorbell output differs from CpuModalEngine::process");
+            return;
+        }
+    }
+
+    for (auto _ : state) {
+        queueDoorbellJob(region->bytes, job, numBanks, nullptr, referenceRegion);
+        ringJob(job);
+        job++;
+    }
+    renderer.stop();
+    state.SetItemsProcessed(state.iterations() * numBanks * kModesPerDrum * kBufferSize);
+}
+BENCHMARK(BM_DoorbellJob)->ArgName("banks")->Arg(1)->Arg(10)->Arg(32)->UseRealTime();
+
+// ----- Mode loading -----
+
+juce::File resourcesDir() {
+    if (const char* envPath = std::getenv("DRUM_GPU_RESOURCES_DIR")) {
+        return juce::File(envPath);
+    }
+    return juce::File(DRUMGPU_BENCH_RESOURCES_DIR);
+}
+
+// Point the mode loader at the text files (binary false) or the pack. False if the pack is missing.
+bool useModeFormat(const juce::File& resources, bool binary) {
+    if (binary) {
+        if (!resources.getChildFile(drumgpu::kModePackFileName).existsAsFile()) {
+            return false;
+        }
+        setEnv("DRUM_GPU_RESOURCES_DIR", resources.getFullPathName().toRawUTF8());
+        return true;
+    }
+    // The same text files, with no pack next to them.
+    const juce::File textOnly = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("drumgpu-bench-text");
+    textOnly.createDirectory();
+    resources.getChildFile("modecoeffs").createSymbolicLink(textOnly.getChildFile("modecoeffs"), true);
+    setEnv("DRUM_GPU_RESOURCES_DIR", textOnly.getFullPathName().toRawUTF8());
+    return true;
+}
+
+// Index the sets and read one, cold: the last loader frees the process-wide library. Arg: binary.
+void BM_LoadModeSet(benchmark::State& state) {
+    const juce::File resources = resourcesDir();
+    const bool binary = state.range(0) != 0;
+    const auto files = resources.getChildFile("modecoeffs").findChildFiles(juce::File::findFiles, false);
+    if (files.isEmpty() || !useModeFormat(resources, binary)) {
+        state.SkipWithError(binary ? "no mode pack (run util/modecoeffs2pack.py)" : "no modecoeffs directory");
+        return;
+    }
+    const std::string label = files.getFirst().getFileName().toStdString();
+    for (auto _ : state) {
+        ModeLoader loader;
+        loader.scanDefaultSet();
+        benchmark::DoNotOptimize(loader.load(label));
+    }
+    state.SetLabel(binary ? "binary" : "text");
+    setEnv("DRUM_GPU_RESOURCES_DIR", resources.getFullPathName().toRawUTF8());
+}
+BENCHMARK(BM_LoadModeSet)->ArgName("binary")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// Processor startup up to its first block: indexing the sets and reading the default kit. Arg: binary.
+void BM_LoadDefaultSet(benchmark::State& state) {
+    const juce::File resources = resourcesDir();
+    const bool binary = state.range(0) != 0;
+    if (!useModeFormat(resources, binary)) {
+        state.SkipWithError("no mode pack (run util/modecoeffs2pack.py)");
+        return;
+    }
+    for (auto _ : state) {
+        webview_plugin::AudioPluginAudioProcessor processor;
+        processor.setPlayConfigDetails(0, 2, kSampleRate, kBufferSize);
+        processor.prepareToPlay(kSampleRate, kBufferSize);
+    }
+    state.SetLabel(binary ? "binary" : "text");
+    setEnv("DRUM_GPU_RESOURCES_DIR", resources.getFullPathName().toRawUTF8());
+}
+BENCHMARK(BM_LoadDefaultSet)->ArgName("binary")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// ----- processBlock -----
+
+// Full processBlock on the CPU engine. Args: host block size, drums played, voices per drum.
+// Each drum played is hit ten times a second, staggered.
+void BM_ProcessBlock(benchmark::State& state) {
+    const int blockSize = static_cast<int>(state.range(0));
+    const int numDrums = static_cast<int>(state.range(1));
+    setEnv("DRUM_GPU_RESOURCES_DIR", resourcesDir().getFullPathName().toRawUTF8());
+    webview_plugin::AudioPluginAudioProcessor processor;
+    for (int drum = 0; drum < webview_plugin::kMaxDrums; drum++) {
+        processor.setVoicesPerDrum(drum, static_cast<int>(state.range(2)));
+    }
+    // Keep every mode: the budget would shed them under load.
+    processor.setNonRealtime(true);
+    processor.setPlayConfigDetails(0, 2, kSampleRate, blockSize);
+    processor.prepareToPlay(kSampleRate, blockSize);
+
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    juce::MidiBuffer midi;
+    const auto hitPeriod = static_cast<int64_t>(kSampleRate / 10);
+    int64_t samples = 0;
+    for (auto _ : state) {
+        midi.clear();
+        for (int drum = 0; drum < numDrums; drum++) {
+            // Octapad notes from 68, as collectMidi maps them.
+            const int64_t phase = (samples + drum * hitPeriod / numDrums) % hitPeriod;
+            const int64_t nextHit = (hitPeriod - phase) % hitPeriod;
+            if (nextHit < blockSize) {
+                midi.addEvent(juce::MidiMessage::noteOn(10, 68 + drum, juce::uint8{100}), static_cast<int>(nextHit));
+            }
+        }
+        buffer.clear();
+        processor.processBlock(buffer, midi);
+        benchmark::DoNotOptimize(buffer.getReadPointer(0));
+        samples += blockSize;
+    }
+    processor.releaseResources();
+    state.SetItemsProcessed(state.iterations() * blockSize);
+    // Audio seconds rendered per second.
+    state.counters["xRealTime"] = benchmark::Counter(static_cast<double>(samples) / kSampleRate, benchmark::Counter::kIsRate);
+    state.SetLabel(processor.getEngineDescription().toStdString());
+}
+BENCHMARK(BM_ProcessBlock)
+    ->ArgNames({"block", "drums", "voices"})
+    ->ArgsProduct({{64, 256, 512, 1024}, {1, 8}, {1, 4}})
+    ->UseRealTime();
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    // Stand in for the GPU server in processBlock.
+    setEnv("DRUM_GPU_FORCE_CPU", "1");
+    juce::ScopedJuceInitialiser_GUI juceInit;
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include "JuceGPUDrum/BlockAdapter.h"
+
+#include <numeric>
+
+namespace drumgpu {
+
+void BlockAdapter::prepare(int blockSize) {
+    latency = blockSize > 0 ? kQuantum - std::gcd(blockSize, kQuantum) : kQuantum - 1;
+    readPos = 0;
+    fill = 0;
+    inputFill = 0;
+    pushSilence(latency);
+}
+
+void BlockAdapter::push(const float* frames, int count) {
+    int writePos = (readPos + fill) % kCapacity;
+    for (int i = 0; i < count; i++) {
+        fifo[2 * writePos] = frames[2 * i];
+        fifo[2 * writePos + 1] = frames[2 * i + 1];
+        writePos = (writePos + 1) % kCapacity;
+    }
+    fill += count;
+}
+
+void BlockAdapter::pushSilence(int count) {
+    int writePos = (readPos + fill) % kCapacity;
+    for (int i = 0; i < count; i++) {
+        fifo[2 * writePos] = 0.0f;
+        fifo[2 * writePos + 1] = 0.0f;
+        writePos = (writePos + 1) % kCapacity;
+    }
+    fill += count;
+}
+
+void BlockAdapter::pop(int count, float* left, float* right) {
+    for (int i = 0; i < count; i++) {
+        if (left) {
+            left[i] = fifo[2 * readPos];
+        }
+        if (right) {
+            right[i] = fifo[2 * readPos + 1];
+        }
+        readPos = (readPos + 1) % kCapacity;
+    }
+    fill -= count;
+}
+
+}  // namespace drumgpu
@@ -0,0 +1,48 @@
+// Doorbell-driven CPU renderer. See CpuDoorbellRenderer.h and Doorbell.h.
+
+#include "JuceGPUDrum/CpuDoorbellRenderer.h"
+
+#include "JuceGPUDrum/ServerStats.h"
+
+namespace drumgpu {
+
+void CpuDoorbellRenderer::start(void* base) {
+    stop();
+    region = base;
+    quit.store(false, std::memory_order_relaxed);
+    thread = std::thread([this] { run(); });
+}
+
+void CpuDoorbellRenderer::stop() {
+    quit.store(true, std::memory_order_relaxed);
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void CpuDoorbellRenderer::run() {
+    ControlBlock* control = RegionView::map(region).control;
+    const int ringSlots = control->ringSlots == 0 ? 1 : static_cast<int>(control->ringSlots);
+    uint32_t job = control->rendered.load(std::memory_order_relaxed);
+    ServerStatsRecorder stats(RegionView::map(region).stats);
+    while (true) {
+        // Poll the doorbell, as the persistent kernel does.
+        while (control->head.load(std::memory_order_acquire) == job) {
+            if (quit.load(std::memory_order_relaxed)) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+        const auto start = ServerStatsRecorder::Clock::now();
+        engine.process(RegionView::map(region, static_cast<int>(job % ringSlots)));
+        const double renderSeconds = ServerStatsRecorder::secondsSince(start);
+        job++;
+        control->rendered.store(job, std::memory_order_release);
+        // The render is all of the job here.
+        stats.record(kServerKernel, renderSeconds);
+        stats.record(kServerTotal, renderSeconds);
+        stats.endJob(static_cast<uint64_t>(engine.getAwakeBanks()) * kModesPerDrum * kBufferSize);
+    }
+}
+
+}  // namespace drumgpu
@@ -0,0 +1,82 @@
+// Lockstep multi-session rendering. See CpuModalBatch.h.
+
+#include "JuceGPUDrum/CpuModalBatch.h"
+
+#include <algorithm>
+
+namespace drumgpu {
+
+CpuModalBatch::CpuModalBatch(int numSessions, int numThreads) : sessions(numSessions), pool(numThreads) {
+    for (Session& session : sessions) {
+        // No pool of its own: a single-worker pool owns no threads.
+        session.engine = std::make_unique<CpuModalEngine>(1);
+    }
+    numActive = numSessions;
+    sweepSessions.reserve(numSessions);
+    sweepTaskEnd.reserve(numSessions);
+}
+
+void CpuModalBatch::process(int session, const RegionView& region) {
+    std::unique_lock<std::mutex> lock(mutex);
+    sessions[session].region = region;
+    sessions[session].submitted = true;
+    numSubmitted++;
+    if (numSubmitted == numActive) {
+        // Last to arrive: render the sweep on this thread.
+        renderSubmitted();
+        return;
+    }
+    const uint64_t waitingFor = sweep;
+    rendered.wait(lock, [&] { return sweep != waitingFor; });
+}
+
+void CpuModalBatch::finish(int session) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!sessions[session].active) {
+        return;
+    }
+    sessions[session].active = false;
+    numActive--;
+    // The others may all be waiting on this one.
+    if (numSubmitted > 0 && numSubmitted == numActive) {
+        renderSubmitted();
+    }
+}
+
+void CpuModalBatch::renderSubmitted() {
+    sweepSessions.clear();
+    sweepTaskEnd.clear();
+    int numTasks = 0;
+    for (int s = 0; s < getNumSessions(); s++) {
+        Session& session = sessions[s];
+        if (!session.submitted) {
+            continue;
+        }
+        const RegionView& region = session.region;
+        numTasks += session.engine->beginBlock(region.modes, region.drumInfo, region.excitations, region.updates,
+                                               pool.numWorkers());
+        sweepSessions.push_back(s);
+        sweepTaskEnd.push_back(numTasks);
+    }
+
+    pool.run(numTasks, &CpuModalBatch::renderTask, this);
+
+    for (int s : sweepSessions) {
+        sessions[s].engine->endBlock(sessions[s].region.output);
+        sessions[s].submitted = false;
+    }
+    numSubmitted = 0;
+    sweep++;
+    rendered.notify_all();
+}
+
+void CpuModalBatch::renderTask(void* batch, int task, int worker) {
+    auto* self = static_cast<CpuModalBatch*>(batch);
+    // Find the session whose range of the sweep holds |task|.
+    const auto it = std::upper_bound(self->sweepTaskEnd.begin(), self->sweepTaskEnd.end(), task);
+    const auto index = static_cast<size_t>(it - self->sweepTaskEnd.begin());
+    const int first = index == 0 ? 0 : self->sweepTaskEnd[index - 1];
+    CpuModalEngine::renderTask(self->sessions[self->sweepSessions[index]].engine.get(), task - first, worker);
+}
+
+}  // namespace drumgpu
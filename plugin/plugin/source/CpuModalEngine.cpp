@@ -0,0 +1,189 @@
+// CPU switched-modal filterbank. See CpuModalEngine.h.
+
+#include "JuceGPUDrum/CpuModalEngine.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace drumgpu {
+
+CpuModalEngine::CpuModalEngine(int numThreads)
+    : kernel(selectModeKernel()),
+      yRe(kNumModes, 0.0f),
+      yIm(kNumModes, 0.0f),
+      poleRe(kNumModes, 0.0f),
+      poleIm(kNumModes, 0.0f),
+      ampRe(kNumModes, 0.0f),
+      ampIm(kNumModes, 0.0f),
+      enabled(kNumModes, 0),
+      chunkEnergy(kNumModes / kChunkModes, 0.0f),
+      bankInput(kMaxBanks * kBufferSize, 0.0f) {
+    setNumThreads(numThreads);
+}
+
+void CpuModalEngine::setNumThreads(int numThreads) {
+    pool.reset();
+    pool = std::make_unique<WorkStealingPool>(numThreads);
+    monoScratch.assign(pool->numWorkers() * kBufferSize, 0.0f);
+    partials.assign(pool->numWorkers() * 2 * kBufferSize, 0.0f);
+}
+
+void CpuModalEngine::reset() {
+    std::fill(yRe.begin(), yRe.end(), 0.0f);
+    std::fill(yIm.begin(), yIm.end(), 0.0f);
+    std::fill(chunkEnergy.begin(), chunkEnergy.end(), 0.0f);
+}
+
+const char* CpuModalEngine::simdName() {
+    return selectModeKernel().name;
+}
+
+void CpuModalEngine::loadModes(const ModeTable* modes, int begin, int end) {
+    for (int i = begin; i < end; i++) {
+        if (modes->flags[i] & kModeReset) {
+            yRe[i] = 0.0f;
+            yIm[i] = 0.0f;
+        }
+        enabled[i] = (modes->flags[i] & kModeEnabled) != 0;
+        const float t = std::exp(-modes->damp[i]);
+        poleRe[i] = t * std::cos(modes->freq[i]);
+        poleIm[i] = t * std::sin(modes->freq[i]);
+    }
+    // Matches filterbankKernel, which drives both components from the real amplitude.
+    std::copy(modes->ampRe + begin, modes->ampRe + end, ampRe.begin() + begin);
+    std::copy(modes->ampRe + begin, modes->ampRe + end, ampIm.begin() + begin);
+}
+
+void CpuModalEngine::renderTask(void* engine, int chunk, int worker) {
+    auto* self = static_cast<CpuModalEngine*>(engine);
+    const int begin = chunk * kChunkModes;
+    const int end = begin + kChunkModes;
+    const int bank = begin / kModesPerDrum;
+
+    if (self->blockUpdates == nullptr) {
+        self->loadModes(self->blockModes, begin, end);
+    } else {
+        for (uint32_t r = 0; r < self->blockUpdates->numRanges; r++) {
+            const ModeRange& range = self->blockUpdates->ranges[r];
+            const int first = std::max(begin, static_cast<int>(range.first));
+            const int last = std::min(end, static_cast<int>(range.first + range.count));
+            if (first < last) {
+                self->loadModes(self->blockModes, first, last);
+            }
+        }
+    }
+
+    if (!self->bankAwake[bank]) {
+        return;
+    }
+    // Render from the first to the last enabled mode. Modes culled by the mode budget form the
+    // tails of the bank's two runs of slots (see ModeFile::slotModes), so reduced banks skip them;
+    // whole vectors keep the scalar tail out of it.
+    int active = kChunkModes;
+    while (active > 0 && !self->enabled[begin + active - 1]) {
+        active--;
+    }
+    if (active == 0) {
+        self->chunkEnergy[chunk] = 0.0f;
+        return;
+    }
+    int skipped = 0;
+    while (!self->enabled[begin + skipped]) {
+        skipped++;
+    }
+    const int width = self->kernel.width;
+    const int activeBegin = begin + skipped / width * width;
+    const int activeEnd = begin + std::min(kChunkModes, (active + width - 1) / width * width);
+
+    float* mono = &self->monoScratch[worker * kBufferSize];
+    std::fill(mono, mono + kBufferSize, 0.0f);
+    const ModeKernelState state = {self->yRe.data(),    self->yIm.data(),   self->poleRe.data(),
+                                   self->poleIm.data(), self->ampRe.data(), self->ampIm.data()};
+    if (self->bankDriven[bank]) {
+        self->kernel.renderDriven(state, activeBegin, activeEnd, &self->bankInput[bank * kBufferSize], mono);
+    } else {
+        self->kernel.renderUndriven(state, activeBegin, activeEnd, nullptr, mono);
+    }
+
+    float energy = 0.0f;
+    for (int i = activeBegin; i < activeEnd; i++) {
+        energy += self->yRe[i] * self->yRe[i] + self->yIm[i] * self->yIm[i];
+    }
+    self->chunkEnergy[chunk] = energy;
+
+    const float pan = self->blockDrumInfo[bank * kDrumInfoStride + 0];
+    float* out = &self->partials[worker * 2 * kBufferSize];
+    for (int s = 0; s < kBufferSize; s++) {
+        out[2 * s + 0] += mono[s] * pan;
+        out[2 * s + 1] += mono[s] * (1 - pan);
+    }
+}
+
+void CpuModalEngine::process(const ModeTable* modes, const float* drumInfo, const ExcitationList* excitations,
+                             float* output, const ModeUpdates* updates) {
+    const int numTasks = beginBlock(modes, drumInfo, excitations, updates, pool->numWorkers());
+    pool->run(numTasks, &CpuModalEngine::renderTask, this);
+    endBlock(output);
+}
+
+int CpuModalEngine::beginBlock(const ModeTable* modes, const float* drumInfo, const ExcitationList* excitations,
+                               const ModeUpdates* updates, int numWorkers) {
+    blockModes = modes;
+    blockUpdates = updates;
+    blockDrumInfo = drumInfo;
+
+    const int numBanks = updates != nullptr ? std::min(static_cast<int>(updates->numBanks), kMaxBanks) : kMaxBanks;
+
+    // Synthesize the input of each bank an excitation is playing in.
+    std::fill(bankDriven, bankDriven + kMaxBanks, 0);
+    const int numEvents = excitations != nullptr ? std::min(static_cast<int>(excitations->numEvents), kMaxExcitations) : 0;
+    for (int e = 0; e < numEvents; e++) {
+        const Excitation& event = excitations->events[e];
+        if (event.bank >= static_cast<uint32_t>(numBanks)) {
+            continue;
+        }
+        float* input = &bankInput[event.bank * kBufferSize];
+        if (!bankDriven[event.bank]) {
+            std::fill(input, input + kBufferSize, 0.0f);
+            bankDriven[event.bank] = 1;
+        }
+        const int first = std::max(event.start, 0);
+        const int last = static_cast<int>(std::min<int64_t>(int64_t{event.start} + event.length, kBufferSize));
+        for (int s = first; s < last; s++) {
+            input[s] += excitationSample(event, s);
+        }
+    }
+
+    // Wake banks that are hit this block; the rest stay awake until they have decayed.
+    constexpr int kChunksPerBank = kModesPerDrum / kChunkModes;
+    awakeBanks = 0;
+    for (int b = 0; b < numBanks; b++) {
+        float energy = 0.0f;
+        for (int c = 0; c < kChunksPerBank; c++) {
+            energy += chunkEnergy[b * kChunksPerBank + c];
+        }
+        bankAwake[b] = bankDriven[b] || energy >= kBankSleepEnergy;
+        awakeBanks += bankAwake[b];
+    }
+
+    if (partials.size() < static_cast<size_t>(numWorkers) * 2 * kBufferSize) {
+        monoScratch.assign(numWorkers * kBufferSize, 0.0f);
+        partials.assign(numWorkers * 2 * kBufferSize, 0.0f);
+    }
+    blockWorkers = numWorkers;
+    std::fill(partials.begin(), partials.begin() + numWorkers * 2 * kBufferSize, 0.0f);
+    return numBanks * kChunksPerBank;
+}
+
+void CpuModalEngine::endBlock(float* output) {
+    // Reduce per-worker partials.
+    std::copy(partials.begin(), partials.begin() + 2 * kBufferSize, output);
+    for (int w = 1; w < blockWorkers; w++) {
+        const float* partial = &partials[w * 2 * kBufferSize];
+        for (int s = 0; s < 2 * kBufferSize; s++) {
+            output[s] += partial[s];
+        }
+    }
+}
+
+}  // namespace drumgpu
@@ -0,0 +1,110 @@
+// Body of a CpuModalKernels.h kernel, included by each kernel's translation unit after it defines
+// its Simd wrapper in an anonymous namespace. Everything here has internal linkage, so the units
+// built with different ISA flags share no symbols.
+//
+// Simd provides a vector type V of kWidth floats, kName, and zero, set1, load, store, add, mul,
+// fmadd (a*b + c), fnmadd (c - a*b) and hsum.
+
+namespace {
+
+using V = Simd::V;
+constexpr int W = Simd::kWidth;
+// Independent vectors advanced together per sample, to hide the latency of the recurrence.
+constexpr int kUnroll = 4;
+
+template <bool kDriven>
+void renderModes(const ModeKernelState& state, int begin, int end, const float* input, float* mono) {
+    float* yRe = state.yRe;
+    float* yIm = state.yIm;
+    const float* poleRe = state.poleRe;
+    const float* poleIm = state.poleIm;
+    const float* ampRe = state.ampRe;
+    const float* ampIm = state.ampIm;
+
+    // Per-sample lane accumulators; reduced to |mono| once per call.
+    alignas(64) float acc[kBufferSize * W];
+    for (int s = 0; s < kBufferSize; s++) {
+        Simd::store(&acc[s * W], Simd::zero());
+    }
+
+    int i = begin;
+    for (; i + kUnroll * W <= end; i += kUnroll * W) {
+        V yr[kUnroll], yi[kUnroll], pr[kUnroll], pi[kUnroll], ar[kUnroll], ai[kUnroll];
+        for (int u = 0; u < kUnroll; u++) {
+            const int m = i + u * W;
+            yr[u] = Simd::load(&yRe[m]);
+            yi[u] = Simd::load(&yIm[m]);
+            pr[u] = Simd::load(&poleRe[m]);
+            pi[u] = Simd::load(&poleIm[m]);
+            ar[u] = Simd::load(&ampRe[m]);
+            ai[u] = Simd::load(&ampIm[m]);
+        }
+        for (int s = 0; s < kBufferSize; s++) {
+            [[maybe_unused]] const V in = kDriven ? Simd::set1(input[s]) : Simd::zero();
+            V sum = Simd::load(&acc[s * W]);
+            for (int u = 0; u < kUnroll; u++) {
+                // y = pole * y + in * amp
+                const V nr = Simd::fnmadd(pi[u], yi[u], Simd::mul(pr[u], yr[u]));
+                const V ni = Simd::fmadd(pi[u], yr[u], Simd::mul(pr[u], yi[u]));
+                if constexpr (kDriven) {
+                    yr[u] = Simd::fmadd(in, ar[u], nr);
+                    yi[u] = Simd::fmadd(in, ai[u], ni);
+                } else {
+                    yr[u] = nr;
+                    yi[u] = ni;
+                }
+                sum = Simd::add(sum, yr[u]);
+            }
+            Simd::store(&acc[s * W], sum);
+        }
+        for (int u = 0; u < kUnroll; u++) {
+            Simd::store(&yRe[i + u * W], yr[u]);
+            Simd::store(&yIm[i + u * W], yi[u]);
+        }
+    }
+    for (; i + W <= end; i += W) {
+        V yr = Simd::load(&yRe[i]);
+        V yi = Simd::load(&yIm[i]);
+        const V pr = Simd::load(&poleRe[i]);
+        const V pi = Simd::load(&poleIm[i]);
+        const V ar = Simd::load(&ampRe[i]);
+        const V ai = Simd::load(&ampIm[i]);
+        for (int s = 0; s < kBufferSize; s++) {
+            const V nr = Simd::fnmadd(pi, yi, Simd::mul(pr, yr));
+            const V ni = Simd::fmadd(pi, yr, Simd::mul(pr, yi));
+            if constexpr (kDriven) {
+                const V in = Simd::set1(input[s]);
+                yr = Simd::fmadd(in, ar, nr);
+                yi = Simd::fmadd(in, ai, ni);
+            } else {
+                yr = nr;
+                yi = ni;
+            }
+            Simd::store(&acc[s * W], Simd::add(Simd::load(&acc[s * W]), yr));
+        }
+        Simd::store(&yRe[i], yr);
+        Simd::store(&yIm[i], yi);
+    }
+
+    for (int s = 0; s < kBufferSize; s++) {
+        mono[s] += Simd::hsum(Simd::load(&acc[s * W]));
+    }
+
+    // Scalar tail when the range isn't a multiple of the vector width.
+    for (; i < end; i++) {
+        float yr = yRe[i];
+        float yi = yIm[i];
+        for (int s = 0; s < kBufferSize; s++) {
+            const float nr = poleRe[i] * yr - poleIm[i] * yi;
+            const float ni = poleRe[i] * yi + poleIm[i] * yr;
+            const float in = kDriven ? input[s] : 0.0f;
+            yr = nr + in * ampRe[i];
+            yi = ni + in * ampIm[i];
+            mono[s] += yr;
+        }
+        yRe[i] = yr;
+        yIm[i] = yi;
+    }
+}
+
+}  // namespace
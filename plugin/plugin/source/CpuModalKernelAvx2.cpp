@@ -0,0 +1,45 @@
+// AVX2 + FMA kernel of the CPU modal engine. See CpuModalKernels.h.
+//
+// Built with AVX2 flags, so it must only be reached through selectModeKernel().
+
+#include "JuceGPUDrum/CpuModalKernels.h"
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+#include "JuceGPUDrum/SharedLayout.h"
+
+namespace drumgpu {
+namespace {
+
+struct Simd {
+    using V = __m256;
+    static constexpr int kWidth = 8;
+    static constexpr const char* kName = "AVX2";
+    static V zero() { return _mm256_setzero_ps(); }
+    static V set1(float x) { return _mm256_set1_ps(x); }
+    static V load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, V v) { _mm256_storeu_ps(p, v); }
+    static V add(V a, V b) { return _mm256_add_ps(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    // selectModeKernel() also requires FMA for this kernel.
+    static V fmadd(V a, V b, V c) { return _mm256_fmadd_ps(a, b, c); }
+    static V fnmadd(V a, V b, V c) { return _mm256_fnmadd_ps(a, b, c); }
+    static float hsum(V v) {
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_movehdup_ps(s));
+        return _mm_cvtss_f32(s);
+    }
+};
+
+}  // namespace
+
+#include "CpuModalKernel.inl"
+
+const ModeKernel kAvx2ModeKernel = {Simd::kName, Simd::kWidth, &renderModes<true>, &renderModes<false>};
+
+}  // namespace drumgpu
+
+#endif
@@ -0,0 +1,46 @@
+// AVX-512 kernel of the CPU modal engine. See CpuModalKernels.h.
+//
+// Built with AVX-512 flags, so it must only be reached through selectModeKernel().
+
+#include "JuceGPUDrum/CpuModalKernels.h"
+
+#if defined(__AVX512F__)
+
+#include <immintrin.h>
+
+#include "JuceGPUDrum/SharedLayout.h"
+
+namespace drumgpu {
+namespace {
+
+struct Simd {
+    using V = __m512;
+    static constexpr int kWidth = 16;
+    static constexpr const char* kName = "AVX-512";
+    static V zero() { return _mm512_setzero_ps(); }
+    static V set1(float x) { return _mm512_set1_ps(x); }
+    static V load(const float* p) { return _mm512_loadu_ps(p); }
+    static void store(float* p, V v) { _mm512_storeu_ps(p, v); }
+    static V add(V a, V b) { return _mm512_add_ps(a, b); }
+    static V mul(V a, V b) { return _mm512_mul_ps(a, b); }
+    static V fmadd(V a, V b, V c) { return _mm512_fmadd_ps(a, b, c); }
+    static V fnmadd(V a, V b, V c) { return _mm512_fnmadd_ps(a, b, c); }
+    static float hsum(V v) {
+        // Spilled rather than _mm512_reduce_add_ps, which trips -Wuninitialized on GCC 12.
+        alignas(64) float lanes[kWidth];
+        _mm512_store_ps(lanes, v);
+        float sum = 0.0f;
+        for (float x : lanes) sum += x;
+        return sum;
+    }
+};
+
+}  // namespace
+
+#include "CpuModalKernel.inl"
+
+const ModeKernel kAvx512ModeKernel = {Simd::kName, Simd::kWidth, &renderModes<true>, &renderModes<false>};
+
+}  // namespace drumgpu
+
+#endif
@@ -0,0 +1,146 @@
+// Baseline kernel of the CPU modal engine and the choice between kernels. See CpuModalKernels.h.
+
+#include "JuceGPUDrum/CpuModalKernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#endif
+
+#include "JuceGPUDrum/SharedLayout.h"
+
+namespace drumgpu {
+namespace {
+
+// The widest vectors every CPU of the target has.
+#if defined(__x86_64__) || defined(_M_X64)
+struct Simd {
+    using V = __m128;
+    static constexpr int kWidth = 4;
+    static constexpr const char* kName = "SSE2";
+    static V zero() { return _mm_setzero_ps(); }
+    static V set1(float x) { return _mm_set1_ps(x); }
+    static V load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, V v) { _mm_storeu_ps(p, v); }
+    static V add(V a, V b) { return _mm_add_ps(a, b); }
+    static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+    static V fmadd(V a, V b, V c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static V fnmadd(V a, V b, V c) { return _mm_sub_ps(c, _mm_mul_ps(a, b)); }
+    static float hsum(V v) {
+        __m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        return _mm_cvtss_f32(s);
+    }
+};
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+struct Simd {
+    using V = float32x4_t;
+    static constexpr int kWidth = 4;
+    static constexpr const char* kName = "NEON";
+    static V zero() { return vdupq_n_f32(0.0f); }
+    static V set1(float x) { return vdupq_n_f32(x); }
+    static V load(const float* p) { return vld1q_f32(p); }
+    static void store(float* p, V v) { vst1q_f32(p, v); }
+    static V add(V a, V b) { return vaddq_f32(a, b); }
+    static V mul(V a, V b) { return vmulq_f32(a, b); }
+#if defined(__aarch64__) || defined(_M_ARM64)
+    static V fmadd(V a, V b, V c) { return vfmaq_f32(c, a, b); }
+    static V fnmadd(V a, V b, V c) { return vfmsq_f32(c, a, b); }
+    static float hsum(V v) { return vaddvq_f32(v); }
+#else
+    static V fmadd(V a, V b, V c) { return vmlaq_f32(c, a, b); }
+    static V fnmadd(V a, V b, V c) { return vmlsq_f32(c, a, b); }
+    static float hsum(V v) {
+        float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+        return vget_lane_f32(vpadd_f32(s, s), 0);
+    }
+#endif
+};
+#else
+struct Simd {
+    using V = float;
+    static constexpr int kWidth = 1;
+    static constexpr const char* kName = "scalar";
+    static V zero() { return 0.0f; }
+    static V set1(float x) { return x; }
+    static V load(const float* p) { return *p; }
+    static void store(float* p, V v) { *p = v; }
+    static V add(V a, V b) { return a + b; }
+    static V mul(V a, V b) { return a * b; }
+    static V fmadd(V a, V b, V c) { return a * b + c; }
+    static V fnmadd(V a, V b, V c) { return c - a * b; }
+    static float hsum(V v) { return v; }
+};
+#endif
+
+}  // namespace
+
+#include "CpuModalKernel.inl"
+
+const ModeKernel kBaselineModeKernel = {Simd::kName, Simd::kWidth, &renderModes<true>, &renderModes<false>};
+
+namespace {
+
+#if defined(DRUMGPU_CPU_KERNEL_AVX2) || defined(DRUMGPU_CPU_KERNEL_AVX512)
+enum class X86Feature { kAvx2Fma, kAvx512 };
+
+// Whether the CPU has the instructions and the OS saves their registers.
+bool cpuSupports(X86Feature feature) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool fma = (info[2] & (1 << 12)) != 0;
+    if (!osxsave) {
+        return false;
+    }
+    const unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    if (feature == X86Feature::kAvx2Fma) {
+        // XMM and YMM state.
+        return (xcr0 & 0x6) == 0x6 && fma && (info[1] & (1 << 5)) != 0;
+    }
+    // Plus the opmask and ZMM state.
+    return (xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 16)) != 0;
+#else
+    // libgcc and compiler-rt check the OS state along with the CPUID bits.
+    __builtin_cpu_init();
+    if (feature == X86Feature::kAvx2Fma) {
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+    return __builtin_cpu_supports("avx512f");
+#endif
+}
+#endif
+
+const ModeKernel& detectModeKernel() {
+#if defined(DRUMGPU_CPU_KERNEL_AVX512)
+    if (cpuSupports(X86Feature::kAvx512)) {
+        return kAvx512ModeKernel;
+    }
+#endif
+#if defined(DRUMGPU_CPU_KERNEL_AVX2)
+    if (cpuSupports(X86Feature::kAvx2Fma)) {
+        return kAvx2ModeKernel;
+    }
+#endif
+    return kBaselineModeKernel;
+}
+
+}  // namespace
+
+const ModeKernel& selectModeKernel() {
+    static const ModeKernel& kernel = detectModeKernel();
+    return kernel;
+}
+
+}  // namespace drumgpu
@@ -0,0 +1,57 @@
+#include "JuceGPUDrum/LatencyStats.h"
+
+#include <algorithm>
+
+namespace drumgpu {
+
+double LatencyHistogram::Snapshot::quantileSeconds(double q) const {
+    if (count == 0) {
+        return 0.0;
+    }
+    const auto rank = static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(count)));
+    uint64_t seen = 0;
+    for (int b = 0; b < kNumBuckets; b++) {
+        seen += counts[b];
+        if (seen >= rank && seen > 0) {
+            return std::min(bucketEdgeSeconds(b), maxSeconds);
+        }
+    }
+    return maxSeconds;
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+    Snapshot snap;
+    for (int b = 0; b < kNumBuckets; b++) {
+        snap.counts[b] = counts[b].load(std::memory_order_relaxed);
+        snap.count += snap.counts[b];
+    }
+    snap.totalSeconds = static_cast<double>(totalMicros.load(std::memory_order_relaxed)) * 1e-6;
+    snap.maxSeconds = static_cast<double>(maxMicros.load(std::memory_order_relaxed)) * 1e-6;
+    return snap;
+}
+
+void LatencyHistogram::reset() {
+    for (auto& count : counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    totalMicros.store(0, std::memory_order_relaxed);
+    maxMicros.store(0, std::memory_order_relaxed);
+}
+
+LatencyStats::Snapshot LatencyStats::snapshot() const {
+    Snapshot snap;
+    for (int s = 0; s < kNumStages; s++) {
+        snap.stages[s] = stages[s].snapshot();
+    }
+    snap.deadlineMisses = deadlineMisses.load(std::memory_order_relaxed);
+    return snap;
+}
+
+void LatencyStats::reset() {
+    for (auto& stage : stages) {
+        stage.reset();
+    }
+    deadlineMisses.store(0, std::memory_order_relaxed);
+}
+
+}  // namespace drumgpu
@@ -0,0 +1,30 @@
+#include "JuceGPUDrum/ModeBudget.h"
+
+namespace drumgpu {
+
+void ModeBudget::prepare(int maxModes, double quantumSeconds) {
+    cap = maxModes > 0 ? std::clamp(maxModes, kMinModesPerBank, kMaxBanks * kModesPerDrum) : kMaxBanks * kModesPerDrum;
+    budget = cap;
+    quantum = quantumSeconds;
+    peakLoad = 0.0;
+}
+
+void ModeBudget::update(double renderSeconds, int numBanks) {
+    if (quantum <= 0.0) {
+        return;
+    }
+    // Budget beyond every mode of the banks in use would only delay the response to load.
+    const int limit = std::clamp(numBanks * kModesPerDrum, kMinModesPerBank, cap);
+    budget = std::min(budget, limit);
+    const double load = renderSeconds / quantum;
+    peakLoad = std::max(load, peakLoad * 0.95);
+    if (load > kHighLoad) {
+        // Back off in proportion to the overrun, never below the per-bank floor.
+        const double scale = std::max(0.5, 0.9 * kHighLoad / load);
+        budget = std::max(static_cast<int>(budget * scale), kMinModesPerBank);
+    } else if (peakLoad < kLowLoad) {
+        budget = std::min(budget + limit / 64, limit);
+    }
+}
+
+}  // namespace drumgpu
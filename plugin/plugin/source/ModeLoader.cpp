@@ -1,11 +1,18 @@
-// ModeLoader loads filter bank coefficients at different regimes from our binary file format.
+// ModeLoader loads filter bank coefficients at different regimes, from the binary pack (ModePack.h)
+// when one is present and from the text files otherwise.
 
 #include "JuceGPUDrum/ModeLoader.h"
+#include "JuceGPUDrum/ModePack.h"
 #include "JuceGPUDrum/globals.h"
 
 #include <juce_core/juce_core.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
 #include <fstream>
+#include <future>
 #include <iostream>
 
 using juce::File;
@@ -13,7 +20,28 @@ using juce::File;
 ModeLoader::ModeLoader() {
 }
 
-void ModeLoader::loadDefaultSet() {
+ModeLoader::~ModeLoader() {
+    stop();
+}
+
+void ModeLoader::scanDefaultSet() {
+    library = sharedLibrary();
+}
+
+std::shared_ptr<ModeLoader::Library> ModeLoader::sharedLibrary() {
+    static std::mutex lock;
+    static std::weak_ptr<Library> shared;
+    std::lock_guard<std::mutex> guard(lock);
+    auto library = shared.lock();
+    if (library == nullptr) {
+        library = std::make_shared<Library>();
+        library->scanDefaultSet();
+        shared = library;
+    }
+    return library;
+}
+
+void ModeLoader::Library::scanDefaultSet() {
     juce::File baseDir;
     bool foundBaseDir = false;
 
@@ -63,19 +91,153 @@ void ModeLoader::loadDefaultSet() {
         baseDir = juce::File("C:\\src\\res\\modecoeffs");
     }
 
+    // Prefer the binary pack converted from this directory (util/modecoeffs2pack.py).
+    juce::File packFile = baseDir.getSiblingFile(drumgpu::kModePackFileName);
+    if (packFile.existsAsFile() && openPack(packFile)) {
+        return;
+    }
+
     bool isRecursive = false;
     for (juce::DirectoryEntry entry : juce::RangedDirectoryIterator(baseDir, isRecursive)) {
         auto foundfile = entry.getFile();
-        auto fullpath = foundfile.getFullPathName().toStdString();
         auto fname = foundfile.getFileName().toStdString();
-        loadSwitchedModalFromFile(fullpath, fname);
-        if (kLogLoadedFiles) {
-            juce::Logger::writeToLog("Loaded mode" + fname);
+        jassert(index.count(fname) == 0);
+        index[fname].file = foundfile;
+    }
+    juce::Logger::writeToLog("Found " + juce::String(index.size()) + " mode sets");
+}
+
+ModeLoader::ModeFilePtr ModeLoader::Library::load(const std::string& label) {
+    auto findResident = [this, &label]() -> ModeFilePtr {
+        auto it = std::find_if(resident.begin(), resident.end(), [&label](const auto& r) { return r.first == label; });
+        if (it == resident.end()) {
+            return nullptr;
+        }
+        resident.splice(resident.begin(), resident, it);
+        return it->second;
+    };
+    {
+        std::lock_guard<std::mutex> lock(cacheLock);
+        if (auto modes = findResident()) {
+            return modes;
+        }
+    }
+
+    auto source = index.find(label);
+    if (source == index.end()) {
+        return nullptr;
+    }
+    auto modes = std::make_shared<ModeFile>();
+    if (source->second.packEntry >= 0) {
+        readPackEntry(source->second.packEntry, *modes);
+    } else {
+        loadSwitchedModalFromFile(source->second.file.getFullPathName().toStdString(), *modes);
+    }
+    normalizeModeFile(*modes, label);
+    if (kLogLoadedFiles) {
+        juce::Logger::writeToLog("Loaded mode" + label);
+    }
+
+    std::lock_guard<std::mutex> lock(cacheLock);
+    // Keep the first copy if another thread read it meanwhile.
+    if (auto existing = findResident()) {
+        return existing;
+    }
+    resident.emplace_front(label, modes);
+    // Evict from the least recently used end. Sets still held elsewhere stay: that includes sets
+    // a processor has unassigned but whose audio thread may still be reading them, which it holds
+    // until the audio thread has moved on (see AudioPluginAudioProcessor::assignDrum).
+    for (auto it = resident.end(); resident.size() > static_cast<size_t>(kMaxResidentModeSets) && it != resident.begin();) {
+        --it;
+        if (it->second.use_count() == 1) {
+            it = resident.erase(it);
         }
     }
+    return modes;
+}
+
+std::vector<ModeLoader::ModeFilePtr> ModeLoader::load(const std::vector<std::string>& labels) {
+    std::vector<ModeFilePtr> sets(labels.size());
+    if (library == nullptr || labels.empty()) {
+        return sets;
+    }
+    // Library::load() parses outside its lock, so sets are read concurrently and merged into the
+    // shared cache as each finishes. Reading is mostly I/O, so this thread blocks on the others
+    // rather than spinning like the audio thread's pool.
+    const size_t numThreads = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, labels.size());
+    std::atomic<size_t> next{0};
+    const auto readSets = [&] {
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < labels.size();) {
+            sets[i] = library->load(labels[i]);
+        }
+    };
+    std::vector<std::future<void>> readers;
+    for (size_t t = 1; t < numThreads; t++) {
+        readers.push_back(std::async(std::launch::async, readSets));
+    }
+    readSets();
+    for (auto& reader : readers) {
+        reader.get();
+    }
+    return sets;
+}
+
+void ModeLoader::loadAsync(const std::string& label, LoadCallback done) {
+    loadAsync(std::vector<std::string>{label}, [done = std::move(done)](std::vector<ModeFilePtr> sets) {
+        done(std::move(sets[0]));
+    });
 }
 
-void ModeLoader::loadSwitchedModalFromFile(std::string fname, std::string label) {
+void ModeLoader::loadAsync(std::vector<std::string> labels, BatchCallback done) {
+    std::lock_guard<std::mutex> lock(queueLock);
+    if (stopping) {
+        return;
+    }
+    if (!loaderThread.joinable()) {
+        loaderThread = std::thread([this] { loaderLoop(); });
+    }
+    queue.push_back({std::move(labels), std::move(done)});
+    queueChanged.notify_all();
+}
+
+void ModeLoader::waitForPendingLoads() {
+    std::unique_lock<std::mutex> lock(queueLock);
+    queueChanged.wait(lock, [this] { return stopping || (queue.empty() && !loading); });
+}
+
+void ModeLoader::stop() {
+    {
+        std::lock_guard<std::mutex> lock(queueLock);
+        stopping = true;
+        queue.clear();
+    }
+    queueChanged.notify_all();
+    if (loaderThread.joinable()) {
+        loaderThread.join();
+    }
+}
+
+void ModeLoader::loaderLoop() {
+    std::unique_lock<std::mutex> lock(queueLock);
+    while (true) {
+        queueChanged.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (stopping) {
+            return;
+        }
+        Request request = std::move(queue.front());
+        queue.pop_front();
+        loading = true;
+        lock.unlock();
+
+        request.done(load(request.labels));
+
+        lock.lock();
+        loading = false;
+        queueChanged.notify_all();
+    }
+}
+
+void ModeLoader::loadSwitchedModalFromFile(const std::string& fname, ModeFile& modes) {
     std::ifstream infile;
     infile.open(fname, std::ios_base::in);
 
@@ -84,19 +246,112 @@ void ModeLoader::loadSwitchedModalFromFile(std::string fname, std::string label)
     // NMODES damps
     // count of low velocity amps
     //    for each: NMODES real/imaginary amps (repeated)
-    if (mode_sets.count(label) > 0) {
-        jassert(0);
-    }
-
     constexpr int NM = 1024;
+    modes.sampleRate = kModeFileSampleRate;
 
     std::string line;
-    ModeFile& modes = mode_sets[label];
     for (int i = 0; i < NM; i++) {
         std::getline(infile, line);
         modes.freqs[i] = (float)::atof(line.c_str());
     }
 
+    for (int i = 0; i < NM; i++) {
+        float real, imag;
+        infile >> real;
+        infile >> imag;
+        modes.amps[i] = std::complex<float>(real, imag);
+    }
+
+    for (int i = 0; i < NM; i++) {
+        infile >> modes.damps[i];
+    }
+
+    int nLowVel = 0;
+    infile >> nLowVel;
+
+    for (int j = 0; j < nLowVel; j++) {
+        std::array<std::complex<float>, 1024> lowvel;
+        for (int i = 0; i < NM; i++) {
+            float real, imag;
+            infile >> real;
+            infile >> imag;
+            lowvel[i] = std::complex<float>(real, imag);
+        }
+        modes.lowvel_amps.push_back(lowvel);
+    }
+}
+
+bool ModeLoader::Library::openPack(const juce::File& packFile) {
+    auto mapped = std::make_unique<juce::MemoryMappedFile>(packFile, juce::MemoryMappedFile::readOnly);
+    const auto* base = static_cast<const char*>(mapped->getData());
+    const size_t size = mapped->getSize();
+    if (base == nullptr || size < sizeof(drumgpu::ModePackHeader)) {
+        return false;
+    }
+
+    constexpr int NM = 1024;
+    const auto* header = reinterpret_cast<const drumgpu::ModePackHeader*>(base);
+    if (std::memcmp(header->magic, drumgpu::kModePackMagic, sizeof(header->magic)) != 0 ||
+        header->version != drumgpu::kModePackVersion || header->modesPerSet != NM || header->fileSize != size ||
+        sizeof(drumgpu::ModePackHeader) + header->numSets * sizeof(drumgpu::ModePackEntry) > size) {
+        juce::Logger::writeToLog("Ignoring invalid mode pack " + packFile.getFullPathName());
+        return false;
+    }
+
+    const auto* entries = reinterpret_cast<const drumgpu::ModePackEntry*>(base + sizeof(drumgpu::ModePackHeader));
+    std::map<std::string, Source> packIndex;
+    for (uint32_t s = 0; s < header->numSets; s++) {
+        const drumgpu::ModePackEntry& entry = entries[s];
+        const size_t numPlanes = drumgpu::kModePackBasePlanes + 2 * size_t{entry.numLowVelocityLayers};
+        if (entry.offset % drumgpu::kModePackAlign != 0 || entry.offset > size ||
+            numPlanes * NM * sizeof(float) > size - entry.offset ||
+            std::memchr(entry.label, '\0', sizeof(entry.label)) == nullptr) {
+            juce::Logger::writeToLog("Ignoring invalid mode pack " + packFile.getFullPathName());
+            return false;
+        }
+        std::string label(entry.label);
+        jassert(packIndex.count(label) == 0);
+        packIndex[label].packEntry = static_cast<int>(s);
+    }
+
+    index = std::move(packIndex);
+    pack = std::move(mapped);
+    juce::Logger::writeToLog("Found " + juce::String(header->numSets) + " mode sets in " +
+                             packFile.getFullPathName());
+    return true;
+}
+
+void ModeLoader::Library::readPackEntry(int entryIndex, ModeFile& modes) const {
+    constexpr int NM = 1024;
+    const auto* base = static_cast<const char*>(pack->getData());
+    const auto& entry = reinterpret_cast<const drumgpu::ModePackEntry*>(base + sizeof(drumgpu::ModePackHeader))[entryIndex];
+
+    // Planes are float32 in the native (little-endian) order, so they're copied straight out.
+    const auto* plane = reinterpret_cast<const float*>(base + entry.offset);
+    const float* freqs = plane;
+    const float* damps = plane + NM;
+    const float* ampsRe = plane + 2 * NM;
+    const float* ampsIm = plane + 3 * NM;
+
+    std::copy(freqs, freqs + NM, modes.freqs.begin());
+    std::copy(damps, damps + NM, modes.damps.begin());
+    for (int i = 0; i < NM; i++) {
+        modes.amps[i] = std::complex<float>(ampsRe[i], ampsIm[i]);
+    }
+    modes.sampleRate = entry.sampleRate != 0 ? static_cast<float>(entry.sampleRate) : kModeFileSampleRate;
+    modes.lowvel_amps.resize(entry.numLowVelocityLayers);
+    for (uint32_t j = 0; j < entry.numLowVelocityLayers; j++) {
+        const float* lowRe = plane + (drumgpu::kModePackBasePlanes + 2 * j) * NM;
+        const float* lowIm = lowRe + NM;
+        for (int i = 0; i < NM; i++) {
+            modes.lowvel_amps[j][i] = std::complex<float>(lowRe[i], lowIm[i]);
+        }
+    }
+}
+
+void ModeLoader::normalizeModeFile(ModeFile& modes, const std::string& label) {
+    constexpr int NM = 1024;
+
     float scale = 1.0f;
     // For open house demo - make cymbals louder
     if (label[0] == '1' || label[0] == '2' ||
@@ -109,10 +364,6 @@ void ModeLoader::loadSwitchedModalFromFile(std::string fname, std::string label)
 
     float mag = 0.0f;
     for (int i = 0; i < NM; i++) {
-        float real, imag;
-        infile >> real;
-        infile >> imag;
-        modes.amps[i] = std::complex<float>(real, imag);
         modes.amps[i] *= scale;
         mag += std::abs(modes.amps[i]);
 
@@ -134,29 +385,43 @@ void ModeLoader::loadSwitchedModalFromFile(std::string fname, std::string label)
     }
 
     for (int i = 0; i < NM; i++) {
-        infile >> modes.damps[i];
         float mindamp = 0.00004f;
         if (std::abs(modes.damps[i]) < mindamp) {
             modes.damps[i] = mindamp;
         }
     }
 
-    int nLowVel = 0;
-    infile >> nLowVel;
-
-    for (int j = 0; j < nLowVel; j++) {
-        std::array<std::complex<float>, 1024> lowvel;
+    for (auto& lowvel : modes.lowvel_amps) {
         for (int i = 0; i < NM; i++) {
-            float real, imag;
-            infile >> real;
-            infile >> imag;
-            lowvel[i] = std::complex<float>(real, imag);
             lowvel[i] /= mag;
         }
-        modes.lowvel_amps.push_back(lowvel);
     }
 
-    mode_sets[label] = modes;
+    // Rank modes by the energy of their impulse response, |amp|^2 / (1 - e^(-2 damp)): loud and
+    // long-ringing modes first.
+    std::array<float, NM> energy;
+    for (int i = 0; i < NM; i++) {
+        energy[i] = std::norm(modes.amps[i]) / -std::expm1(-2.0f * std::abs(modes.damps[i]));
+        modes.order[i] = static_cast<uint16_t>(i);
+    }
+    std::stable_sort(modes.order.begin(), modes.order.end(),
+                     [&energy](uint16_t a, uint16_t b) { return energy[a] > energy[b]; });
+    modes.layoutSlots();
+}
+
+void ModeFile::layoutSlots() {
+    int low = 0;
+    int high = kShimmerFirstMode;
+    lowModes[0] = 0;
+    for (size_t n = 0; n < order.size(); n++) {
+        const int modei = order[n];
+        if (modei < kShimmerFirstMode) {
+            slotModes[static_cast<size_t>(low++)] = order[n];
+        } else {
+            slotModes[static_cast<size_t>(high++)] = order[n];
+        }
+        lowModes[n + 1] = static_cast<uint16_t>(low);
+    }
 }
 
 ModeParams::ModeParams() {
@@ -0,0 +1,350 @@
+// Headless offline renderer: drives AudioPluginAudioProcessor with no audio device or web UI,
+// from a MIDI file or a util/midi2events.py log, and writes the result as a WAV as fast as the
+// engine can go. Reports throughput (x real-time) for the engine backend in use: the GPU server
+// when one is running, otherwise (or with DRUM_GPU_FORCE_CPU=1) the CPU engine.
+//
+// With --batch, renders every session listed in a manifest at once, each with its own processor
+// and kit, in lockstep on one CpuModalBatch: each engine block of all sessions is rendered in a
+// single sweep of one thread pool. Manifest lines are
+//   <input.mid | events.log> <output.wav> [drum,drum,...]
+// with the optional kit naming a mode set for each drum slot in order; # starts a comment.
+//
+// Usage: drumgpu-render [options] <input.mid | events.log> <output.wav>
+//        drumgpu-render [options] --batch <manifest>
+//   --sample-rate HZ   Render rate (default 48000).
+//   --block N          Host block size (default 512).
+//   --tail SECONDS     Rendered after the last note so the drums ring out (default 3).
+//   --beats            Log times are in beats (midi2events.py --beats) rather than milliseconds.
+//   --bpm BPM          Tempo for --beats (default 120, the MIDI default).
+//   --kit DRUMS        Comma-separated mode sets for the drum slots, as in a manifest line.
+//   --threads N        Threads of the --batch pool (default: all hardware threads).
+
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <juce_events/juce_events.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "JuceGPUDrum/CpuModalBatch.h"
+#include "JuceGPUDrum/PluginProcessor.h"
+
+namespace {
+
+struct Options {
+    double sampleRate = 48000.0;
+    int blockSize = 512;
+    double tailSeconds = 3.0;
+    bool logInBeats = false;
+    double bpm = 120.0;
+    int threads = 0;
+    juce::String kit;
+    juce::File batch;
+    juce::StringArray files;
+};
+
+// One input rendered by its own processor.
+struct Session {
+    juce::File input;
+    juce::File output;
+    juce::StringArray kit;
+    juce::MidiMessageSequence notes;
+    std::unique_ptr<webview_plugin::AudioPluginAudioProcessor> processor;
+    juce::AudioBuffer<float> rendered;
+};
+
+void printUsage() {
+    std::fprintf(stderr,
+                 "Usage: drumgpu-render [--sample-rate HZ] [--block N] [--tail SECONDS] [--beats] [--bpm BPM]\n"
+                 "                      [--kit DRUM,DRUM,...] <input.mid | events.log> <output.wav>\n"
+                 "       drumgpu-render [options] [--threads N] --batch <manifest>\n");
+}
+
+juce::File resolve(const juce::String& path) {
+    return juce::File::getCurrentWorkingDirectory().getChildFile(path);
+}
+
+bool parseOptions(const juce::StringArray& args, Options& options) {
+    for (int i = 0; i < args.size(); i++) {
+        const juce::String& arg = args[i];
+        const bool hasValue = i + 1 < args.size();
+        if (arg == "--sample-rate" && hasValue) {
+            options.sampleRate = args[++i].getDoubleValue();
+        } else if (arg == "--block" && hasValue) {
+            options.blockSize = args[++i].getIntValue();
+        } else if (arg == "--tail" && hasValue) {
+            options.tailSeconds = args[++i].getDoubleValue();
+        } else if (arg == "--bpm" && hasValue) {
+            options.bpm = args[++i].getDoubleValue();
+        } else if (arg == "--kit" && hasValue) {
+            options.kit = args[++i];
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = args[++i].getIntValue();
+        } else if (arg == "--batch" && hasValue) {
+            options.batch = resolve(args[++i]);
+        } else if (arg == "--beats") {
+            options.logInBeats = true;
+        } else if (arg.startsWith("--")) {
+            return false;
+        } else {
+            options.files.add(arg);
+        }
+    }
+    const int expectedFiles = options.batch == juce::File() ? 2 : 0;
+    return options.files.size() == expectedFiles && options.sampleRate > 0.0 && options.blockSize > 0 &&
+           options.tailSeconds >= 0.0 && options.bpm > 0.0 && options.threads >= 0;
+}
+
+juce::StringArray parseKit(const juce::String& kit) {
+    juce::StringArray drums;
+    drums.addTokens(kit, ",", "");
+    drums.trim();
+    return drums;
+}
+
+// Sessions listed in a --batch manifest.
+bool readManifest(const juce::File& file, std::vector<Session>& sessions) {
+    juce::StringArray lines;
+    if (!file.existsAsFile()) {
+        return false;
+    }
+    file.readLines(lines);
+    for (const juce::String& line : lines) {
+        juce::StringArray fields;
+        fields.addTokens(line.upToFirstOccurrenceOf("#", false, false), "\t ", "\"");
+        fields.removeEmptyStrings();
+        if (fields.isEmpty()) {
+            continue;
+        }
+        if (fields.size() < 2 || fields.size() > 3) {
+            return false;
+        }
+        Session& session = sessions.emplace_back();
+        session.input = resolve(fields[0].unquoted());
+        session.output = resolve(fields[1].unquoted());
+        session.kit = parseKit(fields[2]);
+    }
+    return !sessions.empty();
+}
+
+// Note-ons of every track, timestamped in seconds.
+bool readMidiFile(const juce::File& file, juce::MidiMessageSequence& notes) {
+    juce::FileInputStream stream(file);
+    juce::MidiFile midi;
+    if (!stream.openedOk() || !midi.readFrom(stream)) {
+        return false;
+    }
+    midi.convertTimestampTicksToSeconds();
+    for (int track = 0; track < midi.getNumTracks(); track++) {
+        for (const auto* event : *midi.getTrack(track)) {
+            if (event->message.isNoteOn()) {
+                notes.addEvent(event->message);
+            }
+        }
+    }
+    notes.sort();
+    return true;
+}
+
+// A util/midi2events.py log: a "Time\tNote\tVelocity" header, then one note-on per line.
+bool readEventLog(const juce::File& file, const Options& options, juce::MidiMessageSequence& notes) {
+    juce::StringArray lines;
+    file.readLines(lines);
+    if (lines.isEmpty() || !lines[0].startsWithIgnoreCase("Time")) {
+        return false;
+    }
+    const double secondsPerUnit = options.logInBeats ? 60.0 / options.bpm : 0.001;
+    for (int i = 1; i < lines.size(); i++) {
+        juce::StringArray fields;
+        fields.addTokens(lines[i], "\t ", "");
+        fields.removeEmptyStrings();
+        if (fields.size() < 3) {
+            continue;
+        }
+        const int note = juce::jlimit(0, 127, fields[1].getIntValue());
+        const auto velocity = static_cast<juce::uint8>(juce::jlimit(1, 127, fields[2].getIntValue()));
+        notes.addEvent(juce::MidiMessage::noteOn(10, note, velocity), fields[0].getDoubleValue() * secondsPerUnit);
+    }
+    notes.sort();
+    return true;
+}
+
+bool readNotes(Session& session, const Options& options) {
+    if (session.input.hasFileExtension("mid;midi")) {
+        return readMidiFile(session.input, session.notes);
+    }
+    return readEventLog(session.input, options, session.notes);
+}
+
+void prepareSession(Session& session, const Options& options) {
+    session.processor = std::make_unique<webview_plugin::AudioPluginAudioProcessor>();
+    auto& processor = *session.processor;
+    for (int drum = 0; drum < std::min(session.kit.size(), webview_plugin::kMaxDrums); drum++) {
+        processor.setDrum(drum, session.kit[drum].toStdString());
+    }
+    processor.setNonRealtime(true);
+    processor.setPlayConfigDetails(0, 2, options.sampleRate, options.blockSize);
+    // Waits for the kit to load.
+    processor.prepareToPlay(options.sampleRate, options.blockSize);
+}
+
+// Run the session's notes through its processor into |session.rendered|.
+void renderSession(Session& session, const Options& options) {
+    auto& processor = *session.processor;
+
+    // Drop the processor's latency from the front of the render so notes land on their times.
+    const int latency = processor.getLatencySamples();
+    const auto& notes = session.notes;
+    const double endSeconds = (notes.getNumEvents() > 0 ? notes.getEndTime() : 0.0) + options.tailSeconds;
+    const auto outputSamples = static_cast<int64_t>(endSeconds * options.sampleRate);
+    const int64_t totalSamples = outputSamples + latency;
+
+    session.rendered.setSize(2, static_cast<int>(outputSamples));
+    session.rendered.clear();
+    juce::AudioBuffer<float> block(2, options.blockSize);
+    juce::MidiBuffer midi;
+    int nextNote = 0;
+
+    // Every block is full-sized, the last one too: a short block would leave the processor's
+    // quantum part-filled, which pads it with silence and raises the latency mid-render.
+    const int numSamples = options.blockSize;
+    for (int64_t blockStart = 0; blockStart < totalSamples; blockStart += numSamples) {
+        block.clear();
+        midi.clear();
+        const int64_t blockEnd = blockStart + numSamples;
+        for (; nextNote < notes.getNumEvents(); nextNote++) {
+            const auto& message = notes.getEventPointer(nextNote)->message;
+            const auto samplePos = static_cast<int64_t>(message.getTimeStamp() * options.sampleRate);
+            if (samplePos >= blockEnd) {
+                break;
+            }
+            midi.addEvent(message, static_cast<int>(std::max<int64_t>(0, samplePos - blockStart)));
+        }
+
+        processor.processBlock(block, midi);
+
+        // Copy what lies past the latency, and before the end, into the render.
+        const int64_t skip = std::max<int64_t>(0, latency - blockStart);
+        if (skip < numSamples) {
+            const auto dest = static_cast<int>(blockStart + skip - latency);
+            const auto count = static_cast<int>(std::min<int64_t>(numSamples - skip, outputSamples - dest));
+            for (int ch = 0; ch < 2; ch++) {
+                session.rendered.copyFrom(ch, dest, block, ch, static_cast<int>(skip), count);
+            }
+        }
+    }
+    processor.releaseResources();
+}
+
+bool writeWav(const Session& session, double sampleRate) {
+    session.output.deleteFile();
+    auto stream = std::make_unique<juce::FileOutputStream>(session.output);
+    juce::WavAudioFormat wav;
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+    if (stream->openedOk()) {
+        writer.reset(wav.createWriterFor(stream.get(), sampleRate, 2, 24, {}, 0));
+    }
+    if (writer != nullptr) {
+        stream.release();  // Now owned by the writer.
+    }
+    return writer != nullptr && writer->writeFromAudioSampleBuffer(session.rendered, 0, session.rendered.getNumSamples());
+}
+
+void setEnv(const char* name, const char* value) {
+#if defined(_WIN32)
+    _putenv_s(name, value);
+#else
+    setenv(name, value, 1);
+#endif
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(juce::StringArray(argv + 1, argc - 1), options)) {
+        printUsage();
+        return 2;
+    }
+
+    std::vector<Session> sessions;
+    const bool batched = options.batch != juce::File();
+    if (batched) {
+        if (!readManifest(options.batch, sessions)) {
+            std::fprintf(stderr, "Couldn't read the batch manifest %s\n", options.batch.getFullPathName().toRawUTF8());
+            return 1;
+        }
+    } else {
+        Session& session = sessions.emplace_back();
+        session.input = resolve(options.files[0]);
+        session.output = resolve(options.files[1]);
+        session.kit = parseKit(options.kit);
+    }
+    for (Session& session : sessions) {
+        if (session.kit.isEmpty() && options.kit.isNotEmpty()) {
+            session.kit = parseKit(options.kit);
+        }
+        if (!readNotes(session, options)) {
+            std::fprintf(stderr, "Couldn't read %s\n", session.input.getFullPathName().toRawUTF8());
+            return 1;
+        }
+    }
+
+    // A batch shares one engine pool, so its processors must not attach to a GPU server (which
+    // serves a single client) or start CPU engine threads of their own.
+    std::unique_ptr<drumgpu::CpuModalBatch> batch;
+    if (batched) {
+        setEnv("DRUM_GPU_FORCE_CPU", "1");
+        setEnv("DRUM_GPU_CPU_THREADS", "1");
+        const int threads = options.threads > 0 ? options.threads
+                                                : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        batch = std::make_unique<drumgpu::CpuModalBatch>(static_cast<int>(sessions.size()), threads);
+    }
+
+    // The processor and its mode loading use the message thread's facilities.
+    juce::ScopedJuceInitialiser_GUI juceInit;
+    for (size_t s = 0; s < sessions.size(); s++) {
+        prepareSession(sessions[s], options);
+        if (batch != nullptr) {
+            sessions[s].processor->setEngineBatch(batch.get(), static_cast<int>(s));
+        }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    if (batch != nullptr) {
+        // Each session runs on its own thread; they meet in the batch once per engine block.
+        std::vector<std::thread> threads;
+        for (size_t s = 0; s < sessions.size(); s++) {
+            threads.emplace_back([&, s] {
+                renderSession(sessions[s], options);
+                batch->finish(static_cast<int>(s));
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    } else {
+        renderSession(sessions[0], options);
+    }
+    const double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double audioSeconds = 0.0;
+    for (const Session& session : sessions) {
+        if (!writeWav(session, options.sampleRate)) {
+            std::fprintf(stderr, "Couldn't write %s\n", session.output.getFullPathName().toRawUTF8());
+            return 1;
+        }
+        const double seconds = session.rendered.getNumSamples() / options.sampleRate;
+        audioSeconds += seconds;
+        std::printf("%s: %d notes, %.2f s of audio\n", session.output.getFileName().toRawUTF8(),
+                    session.notes.getNumEvents(), seconds);
+    }
+    std::printf("%zu session(s), %.2f s of audio in %.3f s (%.1fx real time) with %s\n", sessions.size(),
+                audioSeconds, wallSeconds, wallSeconds > 0.0 ? audioSeconds / wallSeconds : 0.0,
+                sessions[0].processor->getEngineDescription().toRawUTF8());
+    return 0;
+}
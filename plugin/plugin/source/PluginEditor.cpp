@@ -9,6 +9,7 @@
 
 #include "JuceGPUDrum/ParameterIDs.hpp"
 #include "JuceGPUDrum/PluginProcessor.h"
+#include "JuceGPUDrum/SharedLayout.h"
 #include "JuceGPUDrum/globals.h"
 #include "juce_core/juce_core.h"
 #include "juce_graphics/juce_graphics.h"
@@ -78,6 +79,63 @@ std::vector<std::byte> getWebViewFileAsBytes(const juce::String& filepath) {
     return {};
 }
 
+// Latency stats for the web UI: per stage, the mean, p50, p99 and max in milliseconds, the
+// block count and the histogram bucket counts; plus the bucket edges and deadline misses.
+juce::var latencyStatsToVar(const drumgpu::LatencyStats::Snapshot& stats) {
+    juce::DynamicObject::Ptr result{new juce::DynamicObject{}};
+    juce::Array<juce::var> edges;
+    for (int b = 0; b < drumgpu::LatencyHistogram::kNumBuckets; b++) {
+        edges.add(drumgpu::LatencyHistogram::bucketEdgeSeconds(b) * 1e3);
+    }
+    result->setProperty("bucketEdgesMs", edges);
+    result->setProperty("deadlineMisses", static_cast<juce::int64>(stats.deadlineMisses));
+
+    juce::DynamicObject::Ptr stages{new juce::DynamicObject{}};
+    for (int s = 0; s < drumgpu::LatencyStats::kNumStages; s++) {
+        const auto& stage = stats.stages[s];
+        juce::DynamicObject::Ptr stageData{new juce::DynamicObject{}};
+        stageData->setProperty("count", static_cast<juce::int64>(stage.count));
+        stageData->setProperty("meanMs", stage.meanSeconds() * 1e3);
+        stageData->setProperty("p50Ms", stage.quantileSeconds(0.5) * 1e3);
+        stageData->setProperty("p99Ms", stage.quantileSeconds(0.99) * 1e3);
+        stageData->setProperty("maxMs", stage.maxSeconds * 1e3);
+        juce::Array<juce::var> buckets;
+        for (const auto count : stage.counts) {
+            buckets.add(static_cast<int>(count));
+        }
+        stageData->setProperty("buckets", buckets);
+        stages->setProperty(drumgpu::LatencyStats::kStageNames[s], stageData.get());
+    }
+    result->setProperty("stages", stages.get());
+    return result.get();
+}
+
+// The GPU server's published stage timings, in the same units as latencyStatsToVar.
+juce::var serverStatsToVar(const drumgpu::ServerStatsSummary& summary) {
+    juce::DynamicObject::Ptr result{new juce::DynamicObject{}};
+    result->setProperty("jobs", static_cast<juce::int64>(summary.jobs));
+    result->setProperty("windowJobs", static_cast<int>(summary.windowJobs));
+    result->setProperty("blocksPerSecond", summary.blocksPerSecond);
+    result->setProperty("modeSamplesPerSecond", summary.modeSamplesPerSecond);
+    result->setProperty("busyFraction", summary.busyFraction);
+
+    juce::DynamicObject::Ptr stages{new juce::DynamicObject{}};
+    for (int s = 0; s < drumgpu::kNumServerStages; s++) {
+        const auto& stage = summary.stages[s];
+        if (stage.maxUs <= 0.0f) {
+            continue;  // Not a stage of this server.
+        }
+        juce::DynamicObject::Ptr stageData{new juce::DynamicObject{}};
+        stageData->setProperty("meanMs", stage.meanUs * 1e-3);
+        stageData->setProperty("p50Ms", stage.p50Us * 1e-3);
+        stageData->setProperty("p99Ms", stage.p99Us * 1e-3);
+        stageData->setProperty("maxMs", stage.maxUs * 1e-3);
+        stages->setProperty(drumgpu::kServerStageNames[s], stageData.get());
+    }
+    result->setProperty("stages", stages.get());
+    return result.get();
+}
+
 constexpr auto LOCAL_DEV_SERVER_ADDRESS = "http://127.0.0.1:8080";
 }  // namespace
 
@@ -234,6 +292,15 @@ void AudioPluginAudioProcessorEditor::resized() {
 
 void AudioPluginAudioProcessorEditor::timerCallback() {
     webView.emitEventIfBrowserIsVisible("outputLevel", juce::var{});
+    // About twice a second.
+    if (++timerTicks % 8 == 0) {
+        auto stats = latencyStatsToVar(processorRef.getLatencyStats().snapshot());
+        drumgpu::ServerStatsSummary server;
+        if (processorRef.getServerStats(server)) {
+            stats.getDynamicObject()->setProperty("server", serverStatsToVar(server));
+        }
+        webView.emitEventIfBrowserIsVisible("latencyStats", stats);
+    }
 }
 
 auto AudioPluginAudioProcessorEditor::getResource(const juce::String& url) const
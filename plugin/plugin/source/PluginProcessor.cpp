@@ -3,54 +3,39 @@
 #include <juce_audio_processors/juce_audio_processors.h>
 #include <juce_dsp/juce_dsp.h>
 
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <functional>
+#include <thread>
+#include <utility>
 #include <vector>
 
+// Set by the offline renderer target, which builds the processor without the web UI.
+#ifndef DRUMGPU_HEADLESS
+#define DRUMGPU_HEADLESS 0
+#endif
+
 #include "JuceGPUDrum/ParameterIDs.hpp"
+#if !DRUMGPU_HEADLESS
 #include "JuceGPUDrum/PluginEditor.h"
+#endif
+#include "JuceGPUDrum/ServerStats.h"
+#include "JuceGPUDrum/SharedLayout.h"
 #include "JuceGPUDrum/globals.h"
 
 namespace webview_plugin {
 
 // TODO: Handshake this between plugin and server, or at least read from the environment.
-// It's fragile to keep magic constants in sync between one plugin and server, and now we're adding copies of each.
-constexpr int BUFFERSIZE = 256;
-constexpr int NDRUMS = 10;
-constexpr int NMODES = NDRUMS * 1024;
-
-// From v1 Modal Plugin
-#if (JUCE_WINDOWS)
-#include <tchar.h>
-#include <windows.h>
-
-// Synchronization Primitive names
-// Should match those in the CUDA code.
-TCHAR szName[] = TEXT("Local\\GPUModalBankMem");
-TCHAR szNameSemaphore[] = TEXT("Local\\GPUModalBankSemaphore");
-TCHAR szNameSemaphoreGPU[] = TEXT("Local\\GPUModalBankSemaphoreGPU");
-#define SHAREDMEMSIZE 1024 * 512 * 2
-#endif  // JUCE_WINDOWS
-
-#if (JUCE_MAC)
-#include "JuceGPUDrum/MacSharedMemoryRegion.h"
-MacSharedMemoryRegion macSharedMemoryRegion;
-#endif  // JUCE_MAC
-
-struct ModeInfo {
-    bool enabled;
-    bool reset;
+// It's fragile to keep magic constants in sync between one plugin and server; these now live in SharedLayout.h.
+constexpr int BUFFERSIZE = drumgpu::kBufferSize;
+constexpr int NDRUMS = drumgpu::kNumDrums;
+constexpr int NMODES = drumgpu::kNumModes;
 
-    bool amp_changed;
-    float amp_real;
-    float amp_imag;
-
-    float damp;
-
-    float freq;
-    bool freq_changed;
-};
+constexpr int kShimmerFirstMode = ModeFile::kShimmerFirstMode;
 
 struct DrumInfo {
     float pan;
@@ -80,71 +65,70 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
     }
     juce::Logger::writeToLog("drum.GPU: Starting up");
 
-    // Windows: Set up shared memory and synchronization.
-#if (JUCE_WINDOWS)
-    // CLEANUP: Merge this into MacSharedMemoryRegion
-    hMapFile = CreateFileMapping(
-        INVALID_HANDLE_VALUE,  // use paging file,
-        NULL,                  // default security
-        PAGE_READWRITE,
-        0,              // max object size (high-order)
-        SHAREDMEMSIZE,  // max obj size (low-order),
-        szName);
-    if (hMapFile == nullptr) {
-        fprintf(stderr, "shared memory init failed! %d", GetLastError());
-        jassert(0);
-    }
-    pSharedMem = (void*)MapViewOfFile(hMapFile,
-                                      FILE_MAP_ALL_ACCESS,
-                                      0,
-                                      0,
-                                      SHAREDMEMSIZE);
-    if (pSharedMem == nullptr) {
-        // fprintf(stderr, "mapviewoffile failed! %d", GetLastError());
-        CloseHandle(hMapFile);
-        jassert(0);
-    }
-    hSemaphore = CreateSemaphoreA(NULL, 0, 1, szNameSemaphore);
-    if (hSemaphore == nullptr) {
-        // fprintf(stderr, "could not create semaphore %d", GetLastError());
-        CloseHandle(hMapFile);
-        jassert(0);
-    }
-    hSemaphoreGPU = CreateSemaphoreA(NULL, 0, 1, szNameSemaphoreGPU);
-    if (hSemaphoreGPU == nullptr) {
-        // fprintf(stderr, "could not create semaphore %d", GetLastError());
-        CloseHandle(hMapFile);
-        jassert(0);
-    }
-#endif  // WINDOWS
-
-    // Mac: Set up shared memory and synchronization.
-#if (JUCE_MAC)
-    macSharedMemoryRegion.init();
-    if (macSharedMemoryRegion.ready()) {
-        juce::Logger::writeToLog("Mac: Startup: Shared memory and Semaphores ready");
+    // Attach to the GPU server's shared memory and signals; it creates them at startup.
+    const char* forceCpu = std::getenv("DRUM_GPU_FORCE_CPU");
+    if ((forceCpu == nullptr || std::atoi(forceCpu) == 0) && sharedRegion.open()) {
+        ringSlots = sharedRegion.ringSlots();
+        ringHead = sharedRegion.view().control->head.load(std::memory_order_acquire);
+        juce::Logger::writeToLog("Startup: Shared memory and signals ready, " + juce::String(ringSlots) + " block slots");
     } else {
-        juce::Logger::writeToLog("Mac: Startup: Shared memory and Semaphores not ready");
-        jassertfalse;
+        juce::Logger::writeToLog("Startup: Shared memory and signals not ready");
+        useCpuEngine = true;
     }
-#endif  // JUCE_MAC
 
-    modefiles.loadDefaultSet();
-    drum_assignments[0] = &modefiles.mode_sets["kick22yamahabirch"];
-    drum_assignments[1] = &modefiles.mode_sets["tom10dwcoll"];
-    drum_assignments[2] = &modefiles.mode_sets["tom12dwcoll"];
-    drum_assignments[3] = &modefiles.mode_sets["tom16dwcustom"];
+    maxBanks = useCpuEngine ? drumgpu::kMaxBanks : sharedRegion.maxBanks();
+    int voicesPerDrum = kDefaultVoicesPerDrum;
+    if (const char* envVoices = std::getenv("DRUM_GPU_VOICES_PER_DRUM")) {
+        voicesPerDrum = std::atoi(envVoices);
+    }
+    for (int i = 0; i < kMaxDrums; i++) {
+        setVoicesPerDrum(i, voicesPerDrum);
+    }
+    if (const char* envSteal = std::getenv("DRUM_GPU_VOICE_STEAL")) {
+        setVoiceSteal(std::strcmp(envSteal, "oldest") == 0 ? VoiceSteal::kOldest : VoiceSteal::kRoundRobin);
+    }
+    if (const char* envBudget = std::getenv("DRUM_GPU_MODE_BUDGET")) {
+        maxModeBudget = std::max(0, std::atoi(envBudget));
+    }
 
-    drum_assignments[4] = &modefiles.mode_sets["snrLudwigMahogany"];
-    drum_assignments[5] = &modefiles.mode_sets["13_sab_dejonte_crash"];
-    drum_assignments[6] = &modefiles.mode_sets["16_zild_1960s_vintage"];
-    drum_assignments[7] = &modefiles.mode_sets["19_sab_aa_medthin"];
+    if (useCpuEngine) {
+        cpuRegion = std::make_unique<CpuSlot>();
+        int numThreads = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) / 2, 1, kCpuEngineMaxThreads);
+        if (const char* envThreads = std::getenv("DRUM_GPU_CPU_THREADS")) {
+            numThreads = std::max(1, std::atoi(envThreads));
+        }
+        cpuEngine.setNumThreads(numThreads);
+        juce::Logger::writeToLog(juce::String("GPU server unavailable; rendering with CPU engine (") +
+                                 drumgpu::CpuModalEngine::simdName() + ", " + juce::String(numThreads) + " threads)");
+    }
+
+    // Only indexes the sets. The defaults are read in parallel in the background and waited on in
+    // prepareToPlay.
+    modefiles.scanDefaultSet();
+    std::vector<std::string> default_drums = {
+        "kick22yamahabirch",
+        "tom10dwcoll",
+        "tom12dwcoll",
+        "tom16dwcustom",
+
+        "snrLudwigMahogany",
+        "13_sab_dejonte_crash",
+        "16_zild_1960s_vintage",
+        "19_sab_aa_medthin",
+    };
+    modefiles.loadAsync(std::move(default_drums), [this](std::vector<ModeLoader::ModeFilePtr> sets) {
+        for (std::size_t i = 0; i < sets.size(); i++) {
+            assignDrum(static_cast<int>(i), std::move(sets[i]));
+        }
+    });
 
     for (std::size_t i = 0; i < 1024; i++) {
         empty_assignment.amps[i] = {0, 0};
         empty_assignment.freqs[i] = 0;
         empty_assignment.damps[i] = 0.5;
+        empty_assignment.order[i] = static_cast<uint16_t>(i);
     }
+    empty_assignment.layoutSlots();
 
     int s = 0;
     for (int i = 0; i < kMaxDrums; i++) {
@@ -159,7 +143,10 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
     }
 }
 
-AudioPluginAudioProcessor::~AudioPluginAudioProcessor() {}
+AudioPluginAudioProcessor::~AudioPluginAudioProcessor() {
+    // Load callbacks write into this object.
+    modefiles.stop();
+}
 
 const juce::String AudioPluginAudioProcessor::getName() const {
     return JucePlugin_Name;
@@ -226,9 +213,44 @@ void AudioPluginAudioProcessor::prepareToPlay(double sampleRate,
     const int numChannels = kForceMono ? 1 : getTotalNumOutputChannels();
     juce::dsp::ProcessSpec spec{sampleRate, static_cast<juce::uint32>(samplesPerBlock), numChannels};
     initObjects(spec);
+    // Mode sets are rescaled to the host's rate as they're sent to the engine.
+    if (static_cast<float>(sampleRate) != engineSampleRate) {
+        engineSampleRate = static_cast<float>(sampleRate);
+        forceModeUpload = true;
+    }
+    // Start with the drums assigned so far, rather than silence while they load.
+    modefiles.waitForPendingLoads();
+
+    // Let the server render ahead of the host by a fixed number of blocks, and report it.
+    drainRing();
+    lookaheadBlocks = 0;
+    if (!useCpuEngine) {
+        int requested = kDefaultLookaheadBlocks;
+        if (const char* envLookahead = std::getenv("DRUM_GPU_LOOKAHEAD_BLOCKS")) {
+            requested = std::atoi(envLookahead);
+        }
+        lookaheadBlocks = std::clamp(requested, 0, ringSlots - 1);
+    }
+    blockAdapter.prepare(samplesPerBlock);
+    inputSamples = 0;
+    modeBudget.prepare(maxModeBudget, BUFFERSIZE / sampleRate);
+    latencyStats.reset();
+    setLatencySamples(lookaheadBlocks * BUFFERSIZE + blockAdapter.getLatencySamples());
 }
 
-void AudioPluginAudioProcessor::releaseResources() {}
+void AudioPluginAudioProcessor::releaseResources() {
+    drainRing();
+    if (latencyStats.snapshot().stages[drumgpu::LatencyStats::kBlockTotal].count > 0) {
+        juce::Logger::writeToLog(describeLatencyStats());
+    }
+}
+
+void AudioPluginAudioProcessor::drainRing() {
+    while (ringPending > 0) {
+        sharedRegion.waitGPU();
+        ringPending--;
+    }
+}
 
 bool AudioPluginAudioProcessor::isBusesLayoutSupported(
     const BusesLayout& layouts) const {
@@ -253,20 +275,16 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported(
 
 void AudioPluginAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
                                              juce::MidiBuffer& midiMessages) {
-    // Track processBlock times for debugging. Can break and inspect, or print.
+    // Per-stage timings, published through latencyStats. renderQuantum adds to the engine stages.
     using namespace std::chrono;
-    static std::vector<double> histogram;
-
-    auto start = high_resolution_clock::now();
+    const auto start = steady_clock::now();
+    blockStageSeconds.fill(0.0);
 
     juce::ScopedNoDenormals noDenormals;
 
     auto totalNumInputChannels = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
-    float timestretch = 1.0f;
-    float pitchshift = 1.0f;
-
 #if (JUCE_MAC)
     // Server in this repo is Windows-only. Zero out all channels, but run the rest of the function
     // as we bring in the Metal GPU server.
@@ -289,14 +307,164 @@ void AudioPluginAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
         }
     }
     
-    // Process MIDI
-    static float drumVel[NDRUMS];
-    for (int drumi = 0; drumi < NDRUMS; drumi++) {
-        drumVel[drumi] = 0.0f;
+    layoutVoices();
+
+    // The engine renders fixed BUFFERSIZE quanta; the adapter serves them at the host's block
+    // size. MIDI goes to the quantum its input completes.
+    float* outLeft = buffer.getWritePointer(0);
+    float* outRight = buffer.getNumChannels() > 1 ? buffer.getWritePointer(1) : nullptr;
+    int midiBegin = 0;
+    const bool latencyGrew = blockAdapter.process(buffer.getNumSamples(), outLeft, outRight,
+                                                  [&](int inputEnd, float* quantum) {
+                                                      collectMidi(midiMessages, midiBegin, inputEnd);
+                                                      midiBegin = inputEnd;
+                                                      renderQuantum(quantum);
+                                                  });
+    collectMidi(midiMessages, midiBegin, buffer.getNumSamples());
+    inputSamples += buffer.getNumSamples();
+    if (latencyGrew) {
+        // The host sent a block size the latency didn't cover.
+        setLatencySamples(lookaheadBlocks * BUFFERSIZE + blockAdapter.getLatencySamples());
+    }
+
+    // Engine output is now in the first two channels.
+    const auto postFxStart = steady_clock::now();
+    float sampCompIn = 0.0f, sampCompIn2 = 0.0f;
+
+    for (int sample = 0; sample < buffer.getNumSamples(); sample++) {
+        // float input = 0.0f;
+        float sampOut = 0.0f;
+        float sampOut2 = 0.0f;
+
+        // Temporary -- adjust to get more volume in room. TODO: remove
+        constexpr float SCALE_DEMO_LOUD = 2.0f;
+        float samp = outLeft[sample] * SCALE_DEMO_LOUD;
+        float samp2 = (outRight ? outRight[sample] : 0.0f) * SCALE_DEMO_LOUD;
+
+        float mag_final = std::abs(samp);
+        if (mag_final > 1.0f) {
+            samp /= mag_final;
+        }
+        mag_final = std::abs(samp2);
+        if (mag_final > 1.0f) {
+            samp2 /= mag_final;
+        }
+
+        // Simple bus comp, software version.
+        // TODO: fix for stereo or remove
+        sampCompIn = samp;
+        sampCompIn2 = samp2;
+        float compOut = dspBusComp.processSample(0, sampCompIn);
+        float compOut2 = dspBusComp2.processSample(0, sampCompIn2);
+
+        // Output is the sum of drums
+        sampOut = samp;
+        sampOut2 = samp2;
+        // Optionally with bus comp mixed in in parallel.
+        // Lower 10% of slider omits the connection.
+        if (getBusCompValue() > 0.1) {
+            sampOut += getBusCompValue() * compOut;
+            sampOut2 += getBusCompValue() * compOut2;
+        }
+
+        // Mono demos
+        // buffer.setSample(0, sample, sampOut);
+
+        // Stereo demos
+        outLeft[sample] = sampOut;
+        if (outRight) {
+            outRight[sample] = sampOut2;
+        }
     }
-    // int samplepos = 0;
-    // for (juce::MidiBuffer::Iterator midii(midiMessages); midii.getNextEvent(m, samplepos);)
-    for (const auto& mmsg : midiMessages) {
+    // Reverb.
+    reverb.processStereo(buffer.getWritePointer(0), buffer.getWritePointer(1), buffer.getNumSamples());
+
+    const auto end = steady_clock::now();
+    blockStageSeconds[drumgpu::LatencyStats::kPostFx] = duration<double>(end - postFxStart).count();
+    blockStageSeconds[drumgpu::LatencyStats::kBlockTotal] = duration<double>(end - start).count();
+    latencyStats.recordBlock(blockStageSeconds, buffer.getNumSamples() / getSampleRate());
+}
+
+void AudioPluginAudioProcessor::layoutVoices() {
+    std::array<int, kMaxDrums> requested;
+    for (int drumi = 0; drumi < kMaxDrums; drumi++) {
+        requested[drumi] = requestedVoices[drumi].load(std::memory_order_relaxed);
+    }
+    if (requested == laidOutVoices) {
+        return;
+    }
+    laidOutVoices = requested;
+
+    // Every drum gets a voice; extra voices are handed out in drum order while banks last.
+    int spare = std::max(0, maxBanks - NDRUMS);
+    numBanks = 0;
+    for (int drumi = 0; drumi < kMaxDrums; drumi++) {
+        voiceBase[drumi] = numBanks;
+        voiceCount[drumi] = 0;
+        nextVoice[drumi] = 0;
+        if (drumi >= NDRUMS) {
+            continue;
+        }
+        const int extra = std::min(requested[drumi] - 1, spare);
+        spare -= extra;
+        voiceCount[drumi] = 1 + extra;
+        for (int v = 0; v < voiceCount[drumi]; v++) {
+            voices[numBanks++] = {drumi, getPitchshift(drumi), getTimestretch(drumi), getPan(drumi), 0};
+        }
+    }
+    // Banks may now belong to other drums: start them all from silence.
+    numExcitations = 0;
+    reset = true;
+}
+
+void AudioPluginAudioProcessor::startExcitation(int bank, int offset, float velocity) {
+    if (numExcitations == drumgpu::kMaxExcitations) {
+        return;
+    }
+    // Apply attack modification: a linear ramp over the attack, then silence.
+    const float attackMod = drumParams[voices[bank].drum * kNumParamsPerDrum + 5];
+    drumgpu::Excitation& excitation = excitations[numExcitations++];
+    excitation.bank = static_cast<uint32_t>(bank);
+    excitation.shape = drumgpu::kExcitationRamp;
+    excitation.start = offset;
+    if (attackMod < 0.1f) {
+        excitation.length = 100;
+        excitation.slope = velocity / 100.0f / 10.0f;  // Arbitrary and data-dependent. TODO: formalize.
+    } else {
+        // Changing scaling range for Octapad.
+        // CLEANUP: Remove
+        const float spread = BUFFERSIZE * attackMod;
+        excitation.length = static_cast<int>(spread);
+        excitation.slope = velocity / spread / 8.0f;
+    }
+}
+
+int AudioPluginAudioProcessor::triggerVoice(int drum) {
+    const int base = voiceBase[drum];
+    int which = nextVoice[drum];
+    if (voiceSteal.load(std::memory_order_relaxed) == VoiceSteal::kOldest) {
+        for (int v = 0; v < voiceCount[drum]; v++) {
+            if (voices[base + v].lastHit < voices[base + which].lastHit) {
+                which = v;
+            }
+        }
+    }
+    nextVoice[drum] = (which + 1) % voiceCount[drum];
+
+    Voice& voice = voices[base + which];
+    voice.pitchshift = getPitchshift(drum);
+    voice.timestretch = getTimestretch(drum);
+    voice.pan = getPan(drum);
+    voice.lastHit = ++hitCount;
+    return base + which;
+}
+
+void AudioPluginAudioProcessor::collectMidi(const juce::MidiBuffer& midiMessages, int begin, int end) {
+    for (auto it = midiMessages.findNextSamplePosition(begin); it != midiMessages.cend(); ++it) {
+        const auto mmsg = *it;
+        if (mmsg.samplePosition >= end) {
+            break;
+        }
         auto m = mmsg.getMessage();
         if (m.isNoteOn()) {
             int notenum = m.getNoteNumber();
@@ -312,14 +480,21 @@ void AudioPluginAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
                 if (vel > 0.99f)
                     vel = 0.99f;
                 DBG("Drum caught NoteOn: " << notenum << " " << vel);
-                drumVel[whichdrum] = vel;
+                const int offset = static_cast<int>((inputSamples + mmsg.samplePosition) % BUFFERSIZE);
+                startExcitation(triggerVoice(whichdrum), offset, vel);
             }
         }
     }
+}
+
+void AudioPluginAudioProcessor::renderQuantum(float* output) {
+    const auto setupStart = std::chrono::steady_clock::now();
+    float timestretch = 1.0f;
+    float pitchshift = 1.0f;
 
     for (int i = 0; i < kMaxDrums; i++) {
         if (dbgHits[i] > 0) {
-            drumVel[i] = 0.48f * getVolume(i);  // TODO: remove magic number.
+            startExcitation(triggerVoice(i), 0, 0.48f * getVolume(i));  // TODO: remove magic number.
             dbgHits[i] = 0;
         }
     }
@@ -329,55 +504,42 @@ void AudioPluginAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
     for (auto& lfo : lfos_shimmer) {
     	lfo.processSample(0.0f);
     }
+    // Shimmer is per drum, shared by the drum's voices.
+    std::array<float, kMaxDrums> shimmer_samples;
+    for (int drumi = 0; drumi < NDRUMS; drumi++) {
+        shimmer_samples[drumi] = lfos_shimmer[drumi].processSample(0.0f);
+    }
 
     // Set up modes
-    static bool first_block = true;
-    #if (JUCE_WINDOWS)
-        int* sharedmem_modeinfoptr = (int*)pSharedMem;
-    #elif (JUCE_MAC)
-        int* sharedmem_modeinfoptr = (int*)macSharedMemoryRegion.getAddr();
-    #endif
-    float* sharedmem_druminfoptr = (float*)((char*)sharedmem_modeinfoptr + NMODES * sizeof(ModeInfo));
-    float* sharedmem_inputptr = (float*)((char*)sharedmem_druminfoptr + NDRUMS * sizeof(float) * 8);
-    int* sharedmem_outputptr = (int*)((char*)sharedmem_inputptr + NDRUMS * BUFFERSIZE * sizeof(float));
-    // int* sharedmem_outputptr2 = (int*)((char*)sharedmem_outputptr + BUFFERSIZE * sizeof(float));
+    // Same layout whether it's mapped from the server or local to the CPU engine.
+    // With the server, this block's job goes in the next slot of the block ring.
+    const drumgpu::RegionView slot = useCpuEngine ? drumgpu::RegionView::map(cpuRegion->bytes)
+                                                  : sharedRegion.view(static_cast<int>(ringHead % ringSlots));
+    auto* mode_table = slot.modes;
+    float* sharedmem_druminfoptr = slot.drumInfo;
+    auto* excitation_list = slot.excitations;
+    auto* mode_updates = slot.updates;
+    mode_updates->numRanges = 0;
+    mode_updates->numBanks = static_cast<uint32_t>(numBanks);
+    // Each bank renders its set's most significant modes, as many as the budget allows.
+    const int lodModes = modeBudget.modesPerBank(numBanks);
 
     // TODO: Discuss running some of this only outside of a block, or at block N-1 in parallel with GPU
     // in a streaming setup.
-    for (int drumi = 0; drumi < NDRUMS; drumi++) {
-        auto* mf = drum_assignments[drumi];
+    // One bank of modes per voice.
+    for (int banki = 0; banki < numBanks; banki++) {
+        const Voice& voice = voices[banki];
+        const int drumi = voice.drum;
+        const ModeFile* mf = drum_assignments[drumi].load(std::memory_order_seq_cst);
         if (mf == nullptr) {
             mf = &empty_assignment;
         }
 
-        // Cleanup: Move this to an input scaling knob, either in the plugin or in the host.
-        /*
-        // Allow modifying velocity scaling for Demo @ open house
-        // Shows effect of Attack Mod parameter and allows adjusting the velocity curves
-        // for different players.
-        size_t num_velocity_layers = mf->lowvel_amps.size() + 1;
-        float vel_layer_space_occupied = 1.0f / num_velocity_layers;
-        float scalar = getScaledVelocityLayerSelection(drumi);
-        vel_layer_space_occupied /= scalar;
-        int which_velocity_layer = static_cast<int>(drumVel[drumi] / vel_layer_space_occupied);
-        int dbg_layer = static_cast<int>(getDebugVelocityLayer(drumi, static_cast<int>(num_velocity_layers)));
-        if (dbg_layer >= 0) {
-            which_velocity_layer = dbg_layer;
-            if (dbg_layer > 0) {
-                DBG("DBG: scaled velocity layer: " << dbg_layer);
-            }
-        }
-        std::array<std::complex<float>, 1024>* velocityApplication;
-        if (which_velocity_layer >= static_cast<int>(mf->lowvel_amps.size())) {
-            velocityApplication = &mf->amps;
-        } else {
-            velocityApplication = &mf->lowvel_amps[which_velocity_layer];
-        }
-        */
-        pitchshift = getPitchshift(drumi);
-        timestretch = getTimestretch(drumi);
-        // Process shimmer for this drum.
-        float shimmer_sample = lfos_shimmer[drumi].processSample(0.0f);
+        // A drum with one voice follows its knobs; with several, each voice keeps the settings
+        // of the hit it's sounding.
+        pitchshift = voiceCount[drumi] > 1 ? voice.pitchshift : getPitchshift(drumi);
+        timestretch = voiceCount[drumi] > 1 ? voice.timestretch : getTimestretch(drumi);
+        float shimmer_sample = shimmer_samples[drumi];
         float shimmer_low = 0.0f;
         float shimmer_high = 0.0f;
         // Shimmer LFOs may not be used with some versions of the filter bank; ignore warnings.
@@ -391,151 +553,223 @@ void AudioPluginAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
             shimmer_low = 1.0f + shimmer_scale * shimmer_sample;
             shimmer_high = 1.0f + shimmer_scale * -shimmer_sample;
         }
-        for (int modei = 0; modei < 1024; modei++) {
-            int modeidx = drumi * 1024 + modei;
+        // Per-sample frequencies and damping scale inversely with the sample rate.
+        const float rateScale = mf->sampleRate / engineSampleRate;
+        // Only rewrite modes whose inputs changed since the last block.
+        const bool reset_drum = reset || first_block;
+        SentModes& sent = sentModes[banki];
+        // Bank slot j holds mode mf->slotModes[j]. The set's lodModes most significant modes are
+        // in the low slots [0, low) and the shimmered slots [kShimmerFirstMode, kShimmerFirstMode + high);
+        // the rest are culled.
+        const int low = mf->lowModes[static_cast<size_t>(lodModes)];
+        const int high = lodModes - low;
+        // Dirty slots below kShimmerFirstMode, and from it up.
+        int first_low = kShimmerFirstMode;
+        int last_low = 0;
+        int first_high = drumgpu::kModesPerDrum;
+        int last_high = kShimmerFirstMode;
+        if (forceModeUpload || sent.file != mf || sent.pitchshift != pitchshift || sent.timestretch != timestretch ||
+            reset_drum || sent.reset) {
+            // A reset is sent once with the flag set, then again to clear it.
+            first_low = 0;
+            last_low = kShimmerFirstMode;
+            first_high = kShimmerFirstMode;
+            last_high = drumgpu::kModesPerDrum;
+        } else {
+            if (sent.lowModes != low) {
+                first_low = std::min(sent.lowModes, low);
+                last_low = std::max(sent.lowModes, low);
+            }
+            if (do_shimmer != sent.shimmer || (do_shimmer && shimmer_high != sent.shimmer_high)) {
+                first_high = kShimmerFirstMode;
+                last_high = kShimmerFirstMode + std::max(sent.highModes, high);
+            } else if (sent.highModes != high) {
+                first_high = kShimmerFirstMode + std::min(sent.highModes, high);
+                last_high = kShimmerFirstMode + std::max(sent.highModes, high);
+            }
+        }
+        mode_updates->bankGeneration[banki] = sent.generation;
+        if (first_low >= last_low && first_high >= last_high) {
+            continue;
+        }
+        sent = {mf, pitchshift, timestretch, do_shimmer, shimmer_high, reset_drum, low, high, sent.generation + 1};
+        mode_updates->bankGeneration[banki] = sent.generation;
+        // At most two ranges per bank, which kMaxModeRanges allows for. Adjacent ones are merged.
+        if (last_low == first_high) {
+            first_high = first_low;
+            last_low = first_low;
+        }
+        const std::array<std::pair<int, int>, 2> dirty = {{{first_low, last_low}, {first_high, last_high}}};
+        for (const auto& [first_dirty, last_dirty] : dirty) {
+            if (first_dirty < last_dirty) {
+                mode_updates->ranges[mode_updates->numRanges++] = {static_cast<uint32_t>(banki * 1024 + first_dirty),
+                                                                   static_cast<uint32_t>(last_dirty - first_dirty)};
+            }
+        }
 
-            ModeInfo* mode = &((ModeInfo*)sharedmem_modeinfoptr)[modeidx];
+        for (const auto& [first_dirty, last_dirty] : dirty) {
+            for (int slot = first_dirty; slot < last_dirty; slot++) {
+                int modeidx = banki * 1024 + slot;
+                int modei = mf->slotModes[slot];
+
+                // Cull modes beyond the budget: silence them and clear their state.
+                if (slot >= kShimmerFirstMode + high || (slot >= low && slot < kShimmerFirstMode)) {
+                    mode_table->freq[modeidx] = 0.0f;
+                    mode_table->ampRe[modeidx] = 0.0f;
+                    mode_table->ampIm[modeidx] = 0.0f;
+                    mode_table->damp[modeidx] = 0.0f;
+                    mode_table->flags[modeidx] = drumgpu::kModeFreqChanged | drumgpu::kModeAmpChanged | drumgpu::kModeReset;
+                    continue;
+                }
 
-            mode->enabled = true;
-            mode->reset = reset || first_block;
-            mode->freq = mf->freqs[modei] * pitchshift;
+                float freq = mf->freqs[modei] * pitchshift * rateScale;
 
-            // Shimmer test extension to frequency
-            if (do_shimmer) {
-                if (modei < 500) {
-                    // No-op
-                } else {
-                    mode->freq *= shimmer_high;
+                // Shimmer test extension to frequency
+                if (do_shimmer) {
+                    if (modei < kShimmerFirstMode) {
+                        // No-op
+                    } else {
+                        freq *= shimmer_high;
+                    }
                 }
-            }
 
-            mode->freq_changed = true;
-            mode->amp_changed = true;
-            mode->amp_real = mf->amps[modei].real();
-            mode->amp_imag = mf->amps[modei].imag();
+                // Cull modes at or above Nyquist, which would alias: silence them and clear their state.
+                if (freq >= juce::MathConstants<float>::pi) {
+                    mode_table->freq[modeidx] = 0.0f;
+                    mode_table->ampRe[modeidx] = 0.0f;
+                    mode_table->ampIm[modeidx] = 0.0f;
+                    mode_table->damp[modeidx] = 0.0f;
+                    mode_table->flags[modeidx] = drumgpu::kModeFreqChanged | drumgpu::kModeAmpChanged | drumgpu::kModeReset;
+                    continue;
+                }
 
-            mode->damp = mf->damps[modei] * timestretch;
+                mode_table->freq[modeidx] = freq;
+                mode_table->ampRe[modeidx] = mf->amps[modei].real();
+                mode_table->ampIm[modeidx] = mf->amps[modei].imag();
+                mode_table->damp[modeidx] = mf->damps[modei] * timestretch * rateScale;
+                mode_table->flags[modeidx] = drumgpu::kModeEnabled | drumgpu::kModeFreqChanged |
+                                             drumgpu::kModeAmpChanged | (reset_drum ? drumgpu::kModeReset : 0);
+            }
         }
     }
 
     // Set up drum controls
-    // Set up inputs
-    for (int input_drum = 0; input_drum < NDRUMS; input_drum++) {
+    // Set up inputs, per voice
+    for (int input_bank = 0; input_bank < numBanks; input_bank++) {
+        const int input_drum = voices[input_bank].drum;
         float suppressModes [[maybe_unused]] = drumParams[input_drum * kNumParamsPerDrum + 4];
-        float attackMod = drumParams[input_drum * kNumParamsPerDrum + 5];
         // Control params accessible to GPU.
         for (int dpi = 0; dpi < 8; dpi++) {
-            sharedmem_druminfoptr[input_drum * 8 + dpi] = 0.0f;
+            sharedmem_druminfoptr[input_bank * 8 + dpi] = 0.0f;
         }
-        sharedmem_druminfoptr[input_drum * 8 + 0] = getPan(input_drum);
-
-        for (int input_samp = 0; input_samp < BUFFERSIZE; input_samp++) {
-            float input = 0.0f;
-            if (first_block) {
-                // AudioUnits historically had reference to some bug where the first buffer did not process.
-                // CLEANUP: This is likely not needed anymore; check and remove
-            } else {
-                // Apply attack modification
-                if (attackMod < 0.1f) {
-                    float scale = 0.0f;
-                    if (input_samp < 100) {
-                        scale = (input_samp / 100.0f);
-                    }
-                    scale /= 10.0f;  // Arbitrary and data-dependent. TODO: formalize.
-                    input = drumVel[input_drum] * scale;
-                } else {
-                    // Changing scaling range for Octapad.
-                    // CLEANUP: Remove
-                    float scale = 0.0f;
-                    float spread = (BUFFERSIZE * attackMod);
-                    if (input_samp < (int)(spread)) {
-                        scale = (input_samp / spread);
-                    }
-                    scale /= 8.0f;
-                    input = drumVel[input_drum] * scale;
-                }
-            }
-            sharedmem_inputptr[input_drum * BUFFERSIZE + input_samp] = input;
+        sharedmem_druminfoptr[input_bank * 8 + 0] = voiceCount[input_drum] > 1 ? voices[input_bank].pan : getPan(input_drum);
+    }
+    // Send this quantum's excitations; the engine synthesizes the input from them. Keep those that
+    // continue into the next.
+    excitation_list->numEvents = 0;
+    int running = 0;
+    for (int e = 0; e < numExcitations; e++) {
+        drumgpu::Excitation excitation = excitations[e];
+        // AudioUnits historically had reference to some bug where the first buffer did not process.
+        // CLEANUP: This is likely not needed anymore; check and remove
+        if (!first_block && excitation.bank < static_cast<uint32_t>(numBanks)) {
+            excitation_list->events[excitation_list->numEvents++] = excitation;
+        }
+        excitation.start -= BUFFERSIZE;
+        if (excitation.start + excitation.length > 0) {
+            excitations[running++] = excitation;
         }
     }
+    numExcitations = running;
     first_block = false;
+    forceModeUpload = false;
 
     // We have work available for the GPU: Signal our semaphore and wait on the GPU process's.
-#if (JUCE_WINDOWS)
-    ReleaseSemaphore(hSemaphore, 1, NULL);
-    // Cleanup: consider waiting a finite time and disconnecting if we don't hear back.
-    WaitForSingleObject(hSemaphoreGPU, INFINITE);
-#elif (JUCE_MAC)
-    macSharedMemoryRegion.signalCPU();
-    macSharedMemoryRegion.waitGPU();
-#endif
-
-    // GPU process populated shared memory.
-    float* sampsBuf = ((float*)sharedmem_outputptr);
-
-    float sampCompIn = 0.0f, sampCompIn2 = 0.0f;
-
-    for (int sample = 0; sample < buffer.getNumSamples(); sample++) {
-        // float input = 0.0f;
-        float sampOut = 0.0f;
-        float sampOut2 = 0.0f;
-
-        // Temporary -- adjust to get more volume in room. TODO: remove
-        constexpr float SCALE_DEMO_LOUD = 2.0f;
-        sampsBuf[2 * sample] *= SCALE_DEMO_LOUD;
-        sampsBuf[2 * sample + 1] *= SCALE_DEMO_LOUD;
-
-        float mag_final = std::abs(sampsBuf[2 * sample]);
-        if (mag_final > 1.0f) {
-            sampsBuf[2 * sample] /= mag_final;
-        }
-        mag_final = std::abs(sampsBuf[2 * sample + 1]);
-        if (mag_final > 1.0f) {
-            sampsBuf[2 * sample + 1] /= mag_final;
-        }
-
-        // Simple bus comp, software version.
-        // TODO: fix for stereo or remove
-        sampCompIn = sampsBuf[2 * sample];
-        sampCompIn2 = sampsBuf[2 * sample + 1];
-        float compOut = dspBusComp.processSample(0, sampCompIn);
-        float compOut2 = dspBusComp2.processSample(0, sampCompIn2);
-
-        // Output is the sum of drums
-        sampOut = sampsBuf[2 * sample];
-        sampOut2 = sampsBuf[2 * sample + 1];
-        // Optionally with bus comp mixed in in parallel.
-        // Lower 10% of slider omits the connection.
-        if (getBusCompValue() > 0.1) {
-            sampOut += getBusCompValue() * compOut;
-            sampOut2 += getBusCompValue() * compOut2;
+    const auto renderStart = std::chrono::steady_clock::now();
+    blockStageSeconds[drumgpu::LatencyStats::kModeSetup] += std::chrono::duration<double>(renderStart - setupStart).count();
+    if (useCpuEngine && engineBatch != nullptr) {
+        drumgpu::RegionView job = slot;
+        job.output = output;
+        engineBatch->process(batchSession, job);
+    } else if (useCpuEngine) {
+        cpuEngine.process(mode_table, sharedmem_druminfoptr, excitation_list, output, mode_updates);
+    } else {
+        ringHead++;
+        ringPending++;
+        sharedRegion.view().control->head.store(ringHead, std::memory_order_release);
+        sharedRegion.signalCPU();
+
+        // The server may run up to |lookaheadBlocks| ahead; we play the oldest job in flight.
+        if (ringPending > static_cast<uint32_t>(lookaheadBlocks)) {
+            // Cleanup: consider waiting a finite time and disconnecting if we don't hear back.
+            sharedRegion.waitGPU();
+            const uint32_t job = ringHead - ringPending;
+            ringPending--;
+            const float* jobOutput = sharedRegion.view(static_cast<int>(job % ringSlots)).output;
+            std::copy(jobOutput, jobOutput + 2 * BUFFERSIZE, output);
+        } else {
+            // Still filling the lookahead after a (re)start.
+            std::fill(output, output + 2 * BUFFERSIZE, 0.0f);
         }
-
-        // Mono demos
-        // buffer.setSample(0, sample, sampOut);
-
-        // Stereo demos
-        buffer.setSample(0, sample, sampOut);
-        buffer.setSample(1, sample, sampOut2);
     }
-    // Reverb.
-    reverb.processStereo(buffer.getWritePointer(0), buffer.getWritePointer(1), buffer.getNumSamples());
-
-    reset = false;
-
-    if (kLogBufferProcessingTimes) {
-        auto end = high_resolution_clock::now();
-        duration<double, std::milli> elapsed = end - start;
-        histogram.push_back(elapsed.count());
+    const double renderSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+    blockStageSeconds[drumgpu::LatencyStats::kEngineWait] += renderSeconds;
+    // Offline, every mode is rendered however long it takes.
+    if (!isNonRealtime()) {
+        modeBudget.update(renderSeconds, numBanks);
     }
+    reset = false;
+    // Done with this quantum's mode sets; assignDrum() may release the ones it swapped out.
+    quantaRendered.fetch_add(1, std::memory_order_seq_cst);
 }
 
 bool AudioPluginAudioProcessor::hasEditor() const {
-    return true;  // (change this to false if you choose to not supply an editor)
+    return !DRUMGPU_HEADLESS;
 }
 
 juce::AudioProcessorEditor* AudioPluginAudioProcessor::createEditor() {
+#if DRUMGPU_HEADLESS
+    return nullptr;
+#else
     return new AudioPluginAudioProcessorEditor(*this);
+#endif
+}
+
+void AudioPluginAudioProcessor::setEngineBatch(drumgpu::CpuModalBatch* batch, int session) {
+    engineBatch = useCpuEngine ? batch : nullptr;
+    batchSession = session;
+}
+
+juce::String AudioPluginAudioProcessor::describeLatencyStats() const {
+    const auto stats = latencyStats.snapshot();
+    const auto& total = stats.stages[drumgpu::LatencyStats::kBlockTotal];
+    juce::String text = "Block timing over " + juce::String(static_cast<juce::int64>(total.count)) + " blocks, " +
+                        juce::String(static_cast<juce::int64>(stats.deadlineMisses)) + " deadline misses (ms):";
+    for (int s = 0; s < drumgpu::LatencyStats::kNumStages; s++) {
+        const auto& stage = stats.stages[s];
+        text << " " << drumgpu::LatencyStats::kStageNames[s] << " mean " << juce::String(stage.meanSeconds() * 1e3, 3)
+             << " p50 " << juce::String(stage.quantileSeconds(0.5) * 1e3, 3) << " p99 "
+             << juce::String(stage.quantileSeconds(0.99) * 1e3, 3) << " max " << juce::String(stage.maxSeconds * 1e3, 3)
+             << ";";
+    }
+    drumgpu::ServerStatsSummary server;
+    if (getServerStats(server)) {
+        text << "\n" << drumgpu::describeServerStats(server);
+    }
+    return text;
+}
+
+juce::String AudioPluginAudioProcessor::getEngineDescription() const {
+    if (engineBatch != nullptr) {
+        return juce::String("CPU engine batch (") + drumgpu::CpuModalEngine::simdName() + ", " +
+               juce::String(engineBatch->getNumSessions()) + " sessions, " +
+               juce::String(engineBatch->getNumThreads()) + " threads)";
+    }
+    if (useCpuEngine) {
+        return juce::String("CPU engine (") + drumgpu::CpuModalEngine::simdName() + ", " +
+               juce::String(cpuEngine.getNumThreads()) + " threads)";
+    }
+    return "GPU server (" + juce::String(ringSlots) + " block slots, " + juce::String(maxBanks) + " banks)";
 }
 
 void AudioPluginAudioProcessor::getStateInformation(
@@ -716,13 +950,32 @@ void AudioPluginAudioProcessor::loadDrumInSlot([[maybe_unused]] std::string drum
 }
 
 void AudioPluginAudioProcessor::setDrum(int which, std::string name) {
-    if (modefiles.mode_sets.count(name) == 0) {
+    if (!modefiles.hasSet(name) || which < 0 || which >= static_cast<int>(drum_assignments.size())) {
         // jassert(0);
         return;
     }
     juce::Logger::writeToLog("(ok) Setting drum " + std::to_string(which) + " to " + name);
-    drum_assignments[which] = &modefiles.mode_sets[name];
+    // The drum keeps its current set until the new one has loaded.
+    modefiles.loadAsync(name, [this, which](ModeLoader::ModeFilePtr modes) { assignDrum(which, std::move(modes)); });
+}
+
+void AudioPluginAudioProcessor::assignDrum(int which, ModeLoader::ModeFilePtr modes) {
+    if (modes == nullptr) {
+        return;
+    }
+    // Sequentially consistent, with the audio thread's side: either the quantum in progress read
+    // the new set, or quantaRendered read here doesn't count that quantum yet.
+    drum_assignments[which].store(modes.get(), std::memory_order_seq_cst);
+    const uint64_t quantum = quantaRendered.load(std::memory_order_seq_cst);
+    if (drum_sets[which] != nullptr) {
+        retired_sets.push_back({std::move(drum_sets[which]), quantum});
+    }
+    drum_sets[which] = std::move(modes);
     reset = true;
+
+    // Sets held back by earlier swaps that the audio thread has since moved past. While audio is
+    // stopped they stay until the next swap after it restarts.
+    std::erase_if(retired_sets, [quantum](const RetiredSet& set) { return set.quantum < quantum; });
 }
 
 // Deprecated global parameters, replaced with a bank of |kNumCommonParams|.
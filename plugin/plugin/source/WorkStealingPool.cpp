@@ -0,0 +1,170 @@
+// Fork/join pool with work stealing. See WorkStealingPool.h.
+
+#include "JuceGPUDrum/WorkStealingPool.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace drumgpu {
+namespace {
+
+uint64_t packRange(uint32_t begin, uint32_t end) {
+    return (static_cast<uint64_t>(begin) << 32) | end;
+}
+uint32_t rangeBegin(uint64_t r) {
+    return static_cast<uint32_t>(r >> 32);
+}
+uint32_t rangeEnd(uint64_t r) {
+    return static_cast<uint32_t>(r);
+}
+
+void cpuRelax() {
+#if defined(__x86_64__) || defined(_M_X64)
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// Best effort; macOS has no hard affinity, so threads are left to the scheduler there.
+void pinCurrentThread(int core) {
+    const unsigned int numCores = std::thread::hardware_concurrency();
+    if (numCores == 0) {
+        return;
+    }
+    core %= static_cast<int>(numCores);
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(_WIN32)
+    SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << core);
+#else
+    (void)core;
+#endif
+}
+
+}  // namespace
+
+WorkStealingPool::WorkStealingPool(int numWorkers, bool pinThreads) {
+    if (numWorkers < 1) {
+        numWorkers = 1;
+    }
+    for (int i = 0; i < numWorkers; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    // Worker 0 is whoever calls run().
+    for (int i = 1; i < numWorkers; i++) {
+        workers[i]->thread = std::thread([this, i, pinThreads] { threadLoop(i, pinThreads); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    quit.store(true, std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_release);
+    generation.notify_all();
+    for (auto& w : workers) {
+        if (w->thread.joinable()) {
+            w->thread.join();
+        }
+    }
+}
+
+void WorkStealingPool::run(int numTasks, TaskFn fn, void* context) {
+    const int n = numWorkers();
+    if (n == 1) {
+        for (int t = 0; t < numTasks; t++) {
+            fn(context, t, 0);
+        }
+        return;
+    }
+
+    // Every task of the previous run() has finished, so nobody reads these now. A worker still
+    // waking from an earlier run() only reads them after taking a task from a range, and the
+    // release stores of the ranges publish them.
+    taskFn = fn;
+    taskContext = context;
+    pendingTasks.store(numTasks, std::memory_order_relaxed);
+    for (int w = 0; w < n; w++) {
+        const auto begin = static_cast<uint32_t>(numTasks * w / n);
+        const auto end = static_cast<uint32_t>(numTasks * (w + 1) / n);
+        workers[w]->range.store(packRange(begin, end), std::memory_order_release);
+    }
+
+    generation.fetch_add(1, std::memory_order_release);
+    generation.notify_all();
+
+    // Returns once every task has been taken, by this thread or a worker. Then only tasks
+    // running on other workers remain, not workers that haven't woken yet.
+    work(0);
+    while (pendingTasks.load(std::memory_order_acquire) != 0) {
+        cpuRelax();
+    }
+}
+
+void WorkStealingPool::threadLoop(int worker, bool pin) {
+    if (pin) {
+        pinCurrentThread(worker);
+    }
+    uint32_t seen = 0;
+    while (true) {
+        generation.wait(seen, std::memory_order_acquire);
+        seen = generation.load(std::memory_order_acquire);
+        if (quit.load(std::memory_order_relaxed)) {
+            return;
+        }
+        work(worker);
+    }
+}
+
+void WorkStealingPool::work(int worker) {
+    while (true) {
+        int task = popFront(worker);
+        if (task < 0) {
+            task = steal(worker);
+        }
+        if (task < 0) {
+            return;
+        }
+        taskFn(taskContext, task, worker);
+        pendingTasks.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+int WorkStealingPool::popFront(int worker) {
+    auto& range = workers[worker]->range;
+    uint64_t r = range.load(std::memory_order_relaxed);
+    while (rangeBegin(r) < rangeEnd(r)) {
+        if (range.compare_exchange_weak(r, packRange(rangeBegin(r) + 1, rangeEnd(r)), std::memory_order_acq_rel)) {
+            return static_cast<int>(rangeBegin(r));
+        }
+    }
+    return -1;
+}
+
+int WorkStealingPool::steal(int thief) {
+    const int n = numWorkers();
+    for (int k = 1; k < n; k++) {
+        auto& range = workers[(thief + k) % n]->range;
+        uint64_t r = range.load(std::memory_order_relaxed);
+        while (rangeBegin(r) < rangeEnd(r)) {
+            if (range.compare_exchange_weak(r, packRange(rangeBegin(r), rangeEnd(r) - 1), std::memory_order_acq_rel)) {
+                return static_cast<int>(rangeEnd(r) - 1);
+            }
+        }
+    }
+    return -1;
+}
+
+}  // namespace drumgpu
@@ -0,0 +1,97 @@
+# Converts a directory of text mode coefficient files (res/modecoeffs) into the binary pack
+# the plugin maps at startup. Layout: see plugin/plugin/include/JuceGPUDrum/ModePack.h.
+#
+# Usage: python modecoeffs2pack.py [--sample-rate HZ] [modecoeffs dir] [output file]
+# Defaults to res/modecoeffs and res/modecoeffs.dgpack next to it. The sample rate the sets were
+# fitted at is recorded with each one (44100 unless given).
+
+import argparse
+import struct
+import sys
+from array import array
+from pathlib import Path
+
+NMODES = 1024
+MAGIC = b"DGMPACK\0"
+VERSION = 1
+ALIGN = 128
+LABEL_SIZE = 64
+HEADER_FORMAT = "<8sIIIIQ"  # ModePackHeader
+ENTRY_FORMAT = "<64sQII"  # ModePackEntry
+
+
+def align(n):
+    return (n + ALIGN - 1) // ALIGN * ALIGN
+
+
+def read_mode_file(path):
+    """
+    Parse one text mode file as ModeLoader::loadSwitchedModalFromFile does.
+
+    Returns a list of planes: freq, damp, amp real, amp imag, then real and imaginary planes
+    for each low velocity layer.
+    """
+    tokens = path.read_text().split()
+    pos = 0
+
+    def take(count):
+        nonlocal pos
+        values = tokens[pos:pos + count]
+        pos += count
+        # Missing values read as 0, as with atof.
+        return [float(v) for v in values] + [0.0] * (count - len(values))
+
+    freqs = take(NMODES)
+    amps = take(2 * NMODES)
+    damps = take(NMODES)
+    planes = [freqs, damps, amps[0::2], amps[1::2]]
+    num_low_vel = int(take(1)[0])
+    for _ in range(num_low_vel):
+        low_vel = take(2 * NMODES)
+        planes += [low_vel[0::2], low_vel[1::2]]
+    return planes
+
+
+def write_pack(mode_dir, output_file, sample_rate):
+    sets = []
+    for path in sorted(p for p in Path(mode_dir).iterdir() if p.is_file()):
+        label = path.name.encode("utf-8")
+        if len(label) >= LABEL_SIZE:
+            raise ValueError(f"Mode set name too long for the pack: {path.name}")
+        sets.append((label, read_mode_file(path)))
+
+    header_size = struct.calcsize(HEADER_FORMAT)
+    entry_size = struct.calcsize(ENTRY_FORMAT)
+    offset = align(header_size + entry_size * len(sets))
+    entries = []
+    for label, planes in sets:
+        entries.append(struct.pack(ENTRY_FORMAT, label, offset, (len(planes) - 4) // 2, sample_rate))
+        offset = align(offset + len(planes) * NMODES * 4)
+    file_size = offset
+
+    with open(output_file, "wb") as f:
+        f.write(struct.pack(HEADER_FORMAT, MAGIC, VERSION, len(sets), NMODES, 0, file_size))
+        for entry in entries:
+            f.write(entry)
+        for _, planes in sets:
+            f.write(b"\0" * (align(f.tell()) - f.tell()))
+            for plane in planes:
+                data = array("f", plane)
+                if sys.byteorder != "little":
+                    data.byteswap()
+                f.write(data.tobytes())
+        f.write(b"\0" * (file_size - f.tell()))
+
+    print(f"Wrote {len(sets)} mode sets to {output_file} ({file_size} bytes)")
+
+
+if __name__ == "__main__":
+    default_dir = Path(__file__).resolve().parent.parent / "res" / "modecoeffs"
+    parser = argparse.ArgumentParser(description="Convert text mode coefficient files to a binary pack")
+    parser.add_argument("mode_dir", nargs="?", default=str(default_dir), help="Directory of text mode files")
+    parser.add_argument("output_file", nargs="?", help="Output pack (default: modecoeffs.dgpack next to mode_dir)")
+    parser.add_argument("--sample-rate", type=int, default=44100, help="Rate the sets were fitted at, in Hz")
+    args = parser.parse_args()
+
+    output = args.output_file or str(Path(args.mode_dir).resolve().parent / "modecoeffs.dgpack")
+    write_pack(args.mode_dir, output, args.sample_rate)